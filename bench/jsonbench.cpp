@@ -0,0 +1,101 @@
+// Times the RPC reply decoders in src/fastjson.cpp against captured replies.
+//
+// Capture a reply with, for eg.
+//     curl --user user:pass --data-binary '{"jsonrpc":"1.0","id":"x","method":"z_listunspent","params":[]}' \
+//          -H 'content-type: text/plain;' http://127.0.0.1:8232/ > z_listunspent.json
+//
+// and run
+//     jsonbench [--iterations N] --unspent z_listunspent.json --transactions listtransactions.json
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include "fastjson.h"
+
+static QTextStream out(stdout);
+
+// Decode in an arena, the same as RPCWorker does
+static Arena arena;
+
+static int decodeOnce(const QByteArray& body, bool transactions, FastJson::Backend backend) {
+    Arena::Scope scope(arena);
+    if (transactions) {
+        QList<TxRecord> records;
+        return FastJson::decodeTransactions(body, records, backend) ? records.size() : -1;
+    } else {
+        QList<UnspentRecord> records;
+        return FastJson::decodeUnspent(body, records, backend) ? records.size() : -1;
+    }
+}
+
+static void bench(const QString& file, const QByteArray& body, bool transactions,
+                  FastJson::Backend backend, int iterations) {
+    int records = decodeOnce(body, transactions, backend);      // Warm up
+    if (records < 0) {
+        out << file << ": " << FastJson::backendName(backend) << " couldn't decode it" << endl;
+        return;
+    }
+
+    QElapsedTimer t;
+    t.start();
+    for (int i = 0; i < iterations; i++) {
+        decodeOnce(body, transactions, backend);
+    }
+    double ms = t.nsecsElapsed() / 1e6 / iterations;
+    double mbs = ms > 0 ? (body.size() / (1024.0 * 1024.0)) / (ms / 1000.0) : 0;
+
+    out << QString("%1  %2  %3 records  %4 ms  %5 MB/s")
+                .arg(file, -30)
+                .arg(FastJson::backendName(backend), -15)
+                .arg(records, 7)
+                .arg(ms, 9, 'f', 3)
+                .arg(mbs, 8, 'f', 1)
+        << endl;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    auto args = app.arguments();
+    int iterations = 100;
+    QList<QPair<QString, bool>> files;     // file -> is listtransactions
+
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "--iterations" && i + 1 < args.size()) {
+            iterations = qMax(1, args[++i].toInt());
+        } else if (args[i] == "--unspent" && i + 1 < args.size()) {
+            files.push_back(qMakePair(args[++i], false));
+        } else if (args[i] == "--transactions" && i + 1 < args.size()) {
+            files.push_back(qMakePair(args[++i], true));
+        } else {
+            out << "Usage: jsonbench [--iterations N] --unspent <file> ... --transactions <file> ..." << endl;
+            return 1;
+        }
+    }
+
+    if (files.isEmpty()) {
+        out << "Usage: jsonbench [--iterations N] --unspent <file> ... --transactions <file> ..." << endl;
+        return 1;
+    }
+
+    if (!FastJson::hasSimd()) {
+        out << "Built without simdjson, only timing nlohmann::json. Build with CONFIG+=simdjson to compare." << endl;
+    }
+
+    for (auto& f : files) {
+        QFile file(f.first);
+        if (!file.open(QIODevice::ReadOnly)) {
+            out << f.first << ": couldn't open it" << endl;
+            continue;
+        }
+        auto body = file.readAll();
+
+        bench(f.first, body, f.second, FastJson::DOM, iterations);
+        if (FastJson::hasSimd())
+            bench(f.first, body, f.second, FastJson::SIMD, iterations);
+    }
+
+    return 0;
+}
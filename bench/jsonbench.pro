@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Benchmark for the RPC reply decoders in src/fastjson.cpp
+#
+# Build with CONFIG+=simdjson to compare simdjson against nlohmann::json
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+CONFIG   += console c++14
+CONFIG   -= app_bundle
+
+TARGET = jsonbench
+
+TEMPLATE = app
+
+INCLUDEPATH  += ../src/ ../src/3rdparty/
+
+simdjson {
+    DEFINES  += MRC_USE_SIMDJSON
+    CONFIG   += c++17
+    LIBS     += -lsimdjson
+}
+
+SOURCES += \
+    jsonbench.cpp \
+    ../src/fastjson.cpp \
+    ../src/arena.cpp
+
+HEADERS += \
+    ../src/fastjson.h \
+    ../src/arena.h
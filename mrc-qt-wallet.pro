@@ -33,6 +33,18 @@ UI_DIR = src
 
 CONFIG += c++14
 
+# Optional simdjson backend for decoding the big RPC replies. See src/fastjson.h
+simdjson {
+    DEFINES += MRC_USE_SIMDJSON
+    CONFIG  += c++17
+    LIBS    += -lsimdjson
+}
+
+# Count every allocation in the process for the allocation metrics. See src/arena.h
+countallocs {
+    DEFINES += MRC_COUNT_ALLOCS
+}
+
 SOURCES += \
     src/main.cpp \
     src/mainwindow.cpp \
@@ -51,7 +63,24 @@ SOURCES += \
     src/fillediconlabel.cpp \
     src/addressbook.cpp \
     src/logger.cpp \
-    src/addresscombo.cpp
+    src/addresscombo.cpp \
+    src/txcache.cpp \
+    src/txsync.cpp \
+    src/zrecvsync.cpp \
+    src/utxoset.cpp \
+    src/blocknotifier.cpp \
+    src/refreshscheduler.cpp \
+    src/rpcworker.cpp \
+    src/fastjson.cpp \
+    src/jsonstream.cpp \
+    src/arena.cpp \
+    src/concurrencylimiter.cpp \
+    src/circuitbreaker.cpp \
+    src/nodepool.cpp \
+    src/prefetcher.cpp \
+    src/rpcstats.cpp \
+    src/tracer.cpp \
+    src/metricsserver.cpp
 
 HEADERS += \
     src/mainwindow.h \
@@ -71,7 +100,28 @@ HEADERS += \
     src/fillediconlabel.h \
     src/addressbook.h \
     src/logger.h \
-    src/addresscombo.h 
+    src/addresscombo.h \
+    src/txcache.h \
+    src/txsync.h \
+    src/zrecvsync.h \
+    src/utxoset.h \
+    src/blocknotifier.h \
+    src/refreshscheduler.h \
+    src/rpcworker.h \
+    src/mpscqueue.h \
+    src/fastjson.h \
+    src/jsonstream.h \
+    src/rpcmethods.h \
+    src/arena.h \
+    src/promise.h \
+    src/concurrencylimiter.h \
+    src/circuitbreaker.h \
+    src/rpchandle.h \
+    src/nodepool.h \
+    src/prefetcher.h \
+    src/rpcstats.h \
+    src/tracer.h \
+    src/metricsserver.h
 
 FORMS += \
     src/mainwindow.ui \
@@ -84,7 +134,8 @@ FORMS += \
     src/memodialog.ui \ 
     src/connection.ui \
     src/zboard.ui \
-    src/addressbook.ui
+    src/addressbook.ui \
+    src/diagnostics.ui
 
 win32: RC_ICONS = res/icon.ico
 ICON = res/logo.icns
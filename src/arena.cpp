@@ -0,0 +1,152 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<qint64> allocsInArenas  { 0 };
+static std::atomic<qint64> bytesInArenas   { 0 };
+static std::atomic<qint64> allocsOnHeap    { 0 };
+
+#ifdef MRC_COUNT_ALLOCS
+static std::atomic<qint64> allocsInProcess { 0 };
+
+// Count every allocation in the process, so the report shows what a refresh really costs
+void* operator new(std::size_t size) {
+    allocsInProcess++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+// Every allocation is aligned like malloc's, and has a header that says where it came from
+static const size_t alignment = alignof(std::max_align_t);
+
+static thread_local Arena* currentArena = nullptr;
+
+Arena::Arena(size_t blockSize) {
+    this->blockSize    = blockSize;
+    this->minBlockSize = blockSize;
+}
+
+Arena::~Arena() {
+    for (auto& block : blocks) {
+        std::free(block.data);
+    }
+}
+
+void* Arena::allocate(size_t size) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (blocks.empty() || offset + size > blocks.back().size) {
+        Block block;
+        block.size = size > blockSize ? size : blockSize;
+        block.data = static_cast<char*>(std::malloc(block.size));
+        if (block.data == nullptr)
+            throw std::bad_alloc();
+
+        blocks.push_back(block);
+        offset = 0;
+    }
+
+    void* p = blocks.back().data + offset;
+    offset += size;
+    return p;
+}
+
+/**
+ * Free everything, but keep one block for the next decode. If this decode needed more than one block,
+ * that block is made big enough to hold all of it, up to maxKeptSize, so the next one fits.
+ */
+void Arena::reset() {
+    if (blocks.empty())
+        return;
+
+    size_t total = 0;
+    for (auto& block : blocks) {
+        total += block.size;
+    }
+
+    if (blocks.size() > 1 || total > maxKeptSize) {
+        for (auto& block : blocks) {
+            std::free(block.data);
+        }
+        blocks.clear();
+
+        blockSize = total;
+        if (blockSize > maxKeptSize)
+            blockSize = maxKeptSize;
+        if (blockSize < minBlockSize)
+            blockSize = minBlockSize;
+    }
+
+    offset = 0;
+}
+
+Arena* Arena::current() {
+    return currentArena;
+}
+
+Arena::Scope::Scope(Arena& a) : arena(a) {
+    previous = currentArena;
+    currentArena = &arena;
+}
+
+Arena::Scope::~Scope() {
+    currentArena = previous;
+    arena.reset();
+}
+
+void* Arena::allocateTagged(size_t size) {
+    char* p;
+    if (currentArena != nullptr) {
+        p = static_cast<char*>(currentArena->allocate(size + alignment));
+        p[0] = 1;
+
+        allocsInArenas++;
+        bytesInArenas += size;
+    } else {
+        p = static_cast<char*>(::operator new(size + alignment));
+        p[0] = 0;
+
+        allocsOnHeap++;
+    }
+
+    return p + alignment;
+}
+
+void Arena::deallocateTagged(void* ptr) {
+    char* p = static_cast<char*>(ptr) - alignment;
+
+    // Arena memory is only freed when its arena is reset
+    if (p[0] == 0)
+        ::operator delete(p);
+}
+
+AllocStats AllocStats::take() {
+    AllocStats stats;
+    stats.arenaAllocs   = allocsInArenas.exchange(0);
+    stats.arenaBytes    = bytesInArenas.exchange(0);
+    stats.heapAllocs    = allocsOnHeap.exchange(0);
+#ifdef MRC_COUNT_ALLOCS
+    stats.processAllocs = allocsInProcess.exchange(0);
+#endif
+    return stats;
+}
+
+void AllocStats::add(const AllocStats& other) {
+    arenaAllocs += other.arenaAllocs;
+    arenaBytes  += other.arenaBytes;
+    heapAllocs  += other.heapAllocs;
+    if (other.processAllocs >= 0)
+        processAllocs = std::max(processAllocs, (qint64)0) + other.processAllocs;
+}
@@ -0,0 +1,105 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Kept free of the widget headers, so the benchmark in bench/ can build it on its own
+#include <QtGlobal>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * A monotonic allocator for the short lived data of one reply decode: the JSON DOM and its strings.
+ *
+ * Allocating is just bumping a pointer, and freeing does nothing. All of it is released at once
+ * when the arena is reset, and the first block is kept for the next decode, so once it has grown
+ * to the size of a typical reply, decoding one doesn't touch the heap at all.
+ *
+ * An arena is used through ArenaAllocator, which allocates from the arena that is current on the
+ * calling thread (see Scope), or from the heap if there is none. Nothing allocated from an arena
+ * may outlive its Scope.
+ */
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    void*   allocate(size_t size);
+    void    reset();
+
+    static Arena* current();
+
+    // Makes the arena current on this thread while it lives, and resets it when it goes away
+    class Scope {
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+    private:
+        Arena&  arena;
+        Arena*  previous;
+    };
+
+    // Used by ArenaAllocator. These work whether or not there is an arena.
+    static void*    allocateTagged(size_t size);
+    static void     deallocateTagged(void* p);
+
+private:
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    struct Block {
+        char*   data;
+        size_t  size;
+    };
+
+    std::vector<Block>  blocks;
+    size_t              blockSize;
+    size_t              minBlockSize;
+    size_t              offset      = 0;        // In the last block
+
+    static const size_t maxKeptSize = 4 * 1024 * 1024;
+};
+
+/**
+ * Allocation counts since the last take(). The refreshes add them up for the metrics endpoint.
+ *
+ * processAllocs counts every operator new in the process, but only if the wallet was built
+ * with CONFIG+=countallocs. Otherwise it is -1.
+ */
+struct AllocStats {
+    qint64  arenaAllocs     = 0;
+    qint64  arenaBytes      = 0;
+    qint64  heapAllocs      = 0;        // ArenaAllocator allocations that had no arena
+    qint64  processAllocs   = -1;
+
+    static AllocStats take();
+
+    void add(const AllocStats& other);
+};
+
+// A stateless std allocator that allocates from the current Arena
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() = default;
+    template<class U> ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(Arena::allocateTagged(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) {
+        Arena::deallocateTagged(p);
+    }
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return true; }
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return false; }
+
+#endif // ARENA_H
@@ -9,6 +9,7 @@ struct UnspentOutput {
     QString amount;    
     int     confirmations;
     bool    spendable;
+    int     height;         // Block the output was mined in, 0 if it is not mined yet
 };
 
 class BalancesTableModel : public QAbstractTableModel
@@ -0,0 +1,195 @@
+#include "blocknotifier.h"
+#include "rpc.h"
+#include "settings.h"
+#include "refreshscheduler.h"
+
+using json = nlohmann::json;
+
+// The scheduler task of the getblockcount polls
+static const QString pollTask = "blockpoll";
+
+BlockNotifier::BlockNotifier(RPC* _rpc, QObject* _parent, RefreshScheduler* _scheduler, const std::function<void(void)>& _onNewBlock) {
+    this->rpc        = _rpc;
+    this->parent     = _parent;
+    this->scheduler  = _scheduler;
+    this->onNewBlock = _onNewBlock;
+
+    listen();
+}
+
+BlockNotifier::~BlockNotifier() {
+    stop();
+    delete server;
+}
+
+/**
+ * Each running wallet listens on its own name, which is passed to moonroomcashd in the -blocknotify command
+ */
+QString BlockNotifier::serverName() {
+    return "mrc-qt-wallet-blocknotify-" % QString::number(QCoreApplication::applicationPid());
+}
+
+// The -blocknotify command for the embedded moonroomcashd. moonroomcashd replaces %s with the block hash
+QString BlockNotifier::blockNotifyCommand() {
+    return "\"" % QCoreApplication::applicationFilePath() % "\" --blocknotify " % serverName() % " %s";
+}
+
+/**
+ * Called from main() when moonroomcashd runs us with --blocknotify. Pass the block hash on to the
+ * running wallet and return.
+ */
+bool BlockNotifier::notifyRunningWallet(const QString& name, const QString& blockhash) {
+    QLocalSocket socket;
+    socket.connectToServer(name);
+    if (!socket.waitForConnected(1000))
+        return false;
+
+    socket.write(blockhash.toUtf8() + "\n");
+    socket.waitForBytesWritten(1000);
+    socket.disconnectFromServer();
+    if (socket.state() != QLocalSocket::UnconnectedState)
+        socket.waitForDisconnected(1000);
+
+    return true;
+}
+
+void BlockNotifier::listen() {
+    server = new QLocalServer();
+    if (!server->listen(serverName())) {
+        // A previous run might have left the socket file behind
+        QLocalServer::removeServer(serverName());
+        if (!server->listen(serverName())) {
+            qDebug() << "Couldn't listen for block notifications:" << server->errorString();
+            return;
+        }
+    }
+
+    QObject::connect(server, &QLocalServer::newConnection, [=] () {
+        while (server->hasPendingConnections()) {
+            auto socket = server->nextPendingConnection();
+
+            QObject::connect(socket, &QLocalSocket::readyRead, [=] () {
+                socket->readAll();
+                newTip(-1);
+            });
+            QObject::connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+        }
+    });
+}
+
+/**
+ * Start watching the tip of the current connection. The embedded moonroomcashd notifies us over
+ * the local socket, so it doesn't need to be polled.
+ */
+void BlockNotifier::start() {
+    stop();
+
+    if (rpc->getEMoonroomcashD() != nullptr && server->isListening())
+        return;
+
+    if (longPollSupported)
+        longPoll(generation);
+    else
+        poll(generation);
+}
+
+void BlockNotifier::stop() {
+    generation++;
+    lastHeight = -1;
+    polling    = false;
+
+    scheduler->removeTask(pollTask);
+}
+
+void BlockNotifier::longPoll(int gen) {
+    auto conn = rpc->getConnection();
+    if (conn == nullptr || gen != generation)
+        return;
+
+    // Each call waits for up to a minute for a new block
+    int timeout = 60 * 1000;
+
+    conn->call<RPCMethods::WaitForNewBlock>({ timeout }, [=] (RPCMethods::WaitForNewBlock::Result tip) {
+        if (gen != generation)
+            return;
+
+        newTip(tip.height);
+
+        longPoll(gen);
+    }, [=] (const RPCError& rpcError) {
+        if (gen != generation)
+            return;
+
+        // moonroomcashd doesn't know waitfornewblock, so poll getblockcount instead
+        const json& parsed = rpcError.body;
+        auto error = parsed.is_object() ? parsed.find("error") : parsed.end();
+        if (error != parsed.end() && error->is_object() && error->find("code") != error->end() &&
+                (*error)["code"] == -32601) {
+            longPollSupported = false;
+            poll(gen);
+            return;
+        }
+
+        // Probably lost the connection, try again in a bit
+        QTimer::singleShot(Settings::blockPollSpeed, parent, [=] () { longPoll(gen); });
+    });
+}
+
+/**
+ * Poll getblockcount now, and from then on as often as the scheduler runs the poll task
+ */
+void BlockNotifier::poll(int gen) {
+    auto conn = rpc->getConnection();
+    if (conn == nullptr || gen != generation)
+        return;
+
+    scheduler->addTask(pollTask, Settings::blockPollSpeed, true, [=] () {
+        pollOnce(gen);
+    });
+    pollOnce(gen);
+}
+
+void BlockNotifier::pollOnce(int gen) {
+    auto conn = rpc->getConnection();
+    if (conn == nullptr || gen != generation || polling)
+        return;
+
+    polling = true;
+    conn->call<RPCMethods::GetBlockCount>({}, [=] (int height) {
+        if (gen != generation)
+            return;
+
+        polling = false;
+        newTip(height);
+    }, [=] (const RPCError&) {
+        if (gen != generation)
+            return;
+
+        polling = false;
+    });
+}
+
+/**
+ * A new tip was seen. Height is -1 if it isn't known (for eg. from -blocknotify), in which case
+ * the notification is always passed on. Several notifications at once only refresh once.
+ */
+void BlockNotifier::newTip(int height) {
+    if (height >= 0) {
+        bool first   = lastHeight < 0;
+        bool changed = height != lastHeight;
+        lastHeight   = height;
+
+        // The first reply only tells us where the tip is
+        if (first || !changed)
+            return;
+    }
+
+    if (notifyPending)
+        return;
+
+    notifyPending = true;
+    QTimer::singleShot(0, parent, [=] () {
+        notifyPending = false;
+        onNewBlock();
+    });
+}
@@ -0,0 +1,55 @@
+#ifndef BLOCKNOTIFIER_H
+#define BLOCKNOTIFIER_H
+
+#include "precompiled.h"
+
+class RPC;
+class RefreshScheduler;
+
+/**
+ * Tells the wallet as soon as moonroomcashd has a new tip, so the refresh doesn't have to wait for
+ * the next tick of the refresh timer.
+ *
+ * There are two sources:
+ * 1. A local socket. The embedded moonroomcashd is started with -blocknotify, which runs this
+ *    app with --blocknotify, which passes the block hash on to the running wallet over the socket.
+ * 2. A long poll on waitfornewblock. If moonroomcashd doesn't have waitfornewblock, it falls back
+ *    to polling getblockcount every few seconds, which is still much cheaper than getinfo. The
+ *    polls run off the RefreshScheduler, so they back off with the refreshes while the wallet is idle.
+ *
+ * The regular refresh timer keeps running as a slow fallback.
+ */
+class BlockNotifier {
+public:
+    BlockNotifier(RPC* _rpc, QObject* _parent, RefreshScheduler* _scheduler, const std::function<void(void)>& _onNewBlock);
+    ~BlockNotifier();
+
+    void    start();
+    void    stop();
+
+    static QString  serverName();
+    static QString  blockNotifyCommand();
+    static bool     notifyRunningWallet(const QString& server, const QString& blockhash);
+
+private:
+    void    listen();
+    void    longPoll(int generation);
+    void    poll(int generation);
+    void    pollOnce(int generation);
+    void    newTip(int height);
+
+    RPC*                rpc;
+    QObject*            parent;
+    RefreshScheduler*   scheduler;
+    QLocalServer*       server      = nullptr;
+
+    std::function<void(void)> onNewBlock;
+
+    int     generation              = 0;        // Bumped on every start/stop, so old polls stop looping
+    int     lastHeight              = -1;
+    bool    longPollSupported       = true;
+    bool    notifyPending           = false;
+    bool    polling                 = false;    // A getblockcount is in flight
+};
+
+#endif // BLOCKNOTIFIER_H
@@ -0,0 +1,73 @@
+#include "circuitbreaker.h"
+
+// Failures in a row before the breaker opens
+static const int failureThreshold   = 3;
+
+static const int firstHeartbeat     = 1000;
+static const int maxHeartbeat       = 15 * 1000;
+
+CircuitBreaker::CircuitBreaker(const std::function<void(void)>& heartbeat) {
+    this->heartbeat = heartbeat;
+
+    timer = new QTimer();
+    timer->setSingleShot(true);
+    QObject::connect(timer, &QTimer::timeout, [=] () {
+        if (open)
+            this->heartbeat();
+    });
+}
+
+CircuitBreaker::~CircuitBreaker() {
+    delete timer;
+}
+
+bool CircuitBreaker::allows(RPCPriority priority) const {
+    return !open || priority == Interactive;
+}
+
+// moonroomcashd didn't get to answer at all. Errors it sent back (for eg. a JSON-RPC error) don't count.
+bool CircuitBreaker::isUnreachable(QNetworkReply::NetworkError code) {
+    return code == QNetworkReply::ConnectionRefusedError || code == QNetworkReply::RemoteHostClosedError ||
+           code == QNetworkReply::HostNotFoundError      || code == QNetworkReply::TimeoutError ||
+           code == QNetworkReply::TemporaryNetworkFailureError || code == QNetworkReply::UnknownNetworkError;
+}
+
+void CircuitBreaker::record(const RPCError& error) {
+    // Says nothing about moonroomcashd
+    if (error.code == QNetworkReply::OperationCanceledError)
+        return;
+
+    if (!isUnreachable(error.code)) {
+        failures = 0;
+        if (open) {
+            open = false;
+            timer->stop();
+
+            qDebug() << "moonroomcashd is answering again";
+            if (onRecovered)
+                onRecovered();
+        }
+        return;
+    }
+
+    failures++;
+    if (!open) {
+        if (failures >= failureThreshold)
+            trip();
+        return;
+    }
+
+    // The heartbeat (or something interactive) failed too, so wait longer for the next one
+    delay = delay * 2;
+    if (delay > maxHeartbeat)
+        delay = maxHeartbeat;
+    timer->start(delay);
+}
+
+void CircuitBreaker::trip() {
+    qDebug() << "moonroomcashd stopped answering after" << failures << "failures, pausing the refreshes";
+
+    open  = true;
+    delay = firstHeartbeat;
+    timer->start(delay);
+}
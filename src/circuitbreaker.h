@@ -0,0 +1,44 @@
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include "precompiled.h"
+#include "rpcworker.h"
+
+/**
+ * Stops the refreshes from piling up requests on a moonroomcashd that has stopped answering.
+ *
+ * After a few requests in a row fail because moonroomcashd couldn't be reached or timed out, the
+ * breaker opens. While it is open, only the interactive requests are sent. Everything else fails
+ * right away, and instead the breaker sends a cheap heartbeat (getblockcount), backing off up to
+ * every 15 seconds. The first request that gets any reply closes it again, and onRecovered is run
+ * so the wallet can refresh at once.
+ *
+ * Only used on the UI thread.
+ */
+class CircuitBreaker {
+public:
+    CircuitBreaker(const std::function<void(void)>& heartbeat);
+    ~CircuitBreaker();
+
+    bool    isOpen() const { return open; }
+    bool    allows(RPCPriority priority) const;
+
+    void    record(const RPCError& error);      // How a request went
+    void    setOnRecovered(const std::function<void(void)>& fn) { onRecovered = fn; }
+
+    // moonroomcashd didn't get to answer at all
+    static bool isUnreachable(QNetworkReply::NetworkError code);
+
+private:
+    void    trip();
+
+    std::function<void(void)>   heartbeat;
+    std::function<void(void)>   onRecovered;
+    QTimer*                     timer;
+
+    bool    open        = false;
+    int     failures    = 0;        // In a row
+    int     delay       = 0;        // Until the next heartbeat, in ms
+};
+
+#endif // CIRCUITBREAKER_H
@@ -0,0 +1,54 @@
+#include "concurrencylimiter.h"
+
+// Replies this much slower than the baseline (plus some slack for small ones) mean moonroomcashd is queueing
+static const double latencyTolerance    = 2.0;
+static const double latencySlackMs      = 2;
+
+ConcurrencyLimiter::ConcurrencyLimiter(int initial, int minLimit, int maxLimit) {
+    this->current  = initial;
+    this->minLimit = minLimit;
+    this->maxLimit = maxLimit;
+}
+
+void ConcurrencyLimiter::onReply(qint64 ms, int items) {
+    double latency = (double)ms / (items > 0 ? items : 1);
+    average   = average   == 0 ? latency : 0.8 * average   + 0.2 * latency;
+    roundTrip = roundTrip == 0 ? ms      : 0.8 * roundTrip + 0.2 * ms;
+
+    // The baseline slowly drifts up, so it follows the node if it gets slower for good, for eg. as the wallet grows
+    if (baseline == 0 || latency < baseline)
+        baseline = latency;
+    else
+        baseline *= 1.01;
+
+    sinceChange++;
+    if (sinceChange < current)
+        return;
+
+    // A full window of replies came back
+    if (average > latencyTolerance * baseline + latencySlackMs) {
+        decrease();
+    } else if (current < maxLimit) {
+        current++;
+        sinceChange = 0;
+    }
+}
+
+void ConcurrencyLimiter::onRejected() {
+    decrease();
+}
+
+void ConcurrencyLimiter::decrease() {
+    // The other requests that were in flight say the same thing, so only listen to the first one
+    if (lastDecrease.isValid() && lastDecrease.elapsed() < roundTrip)
+        return;
+
+    current = current / 2;
+    if (current < minLimit)
+        current = minLimit;
+
+    sinceChange = 0;
+    lastDecrease.start();
+
+    qDebug() << "Daemon is overloaded, sending at most" << current << "requests at a time";
+}
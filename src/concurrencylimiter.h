@@ -0,0 +1,43 @@
+#ifndef CONCURRENCYLIMITER_H
+#define CONCURRENCYLIMITER_H
+
+#include "precompiled.h"
+
+/**
+ * An adaptive bound on the requests in flight, so a big refresh settles at what moonroomcashd can
+ * keep up with instead of overrunning its work queue (-rpcworkqueue).
+ *
+ * It is AIMD, like TCP's congestion window: after a full window of replies that came back
+ * without a rise in latency, the limit grows by one. When moonroomcashd rejects a request because
+ * its work queue is full, or the replies take much longer than the fastest ones did lately (they
+ * are queueing up in the daemon), the limit is halved. Latency is per item, since batches are of
+ * any size. It is halved at most once
+ * per round trip, since the requests that were already in flight come back the same way.
+ *
+ * Only used on the network thread.
+ */
+class ConcurrencyLimiter {
+public:
+    ConcurrencyLimiter(int initial, int minLimit, int maxLimit);
+
+    int     limit() const { return current; }
+
+    void    onReply(qint64 ms, int items);      // A reply for a batch of items came back, after ms
+    void    onRejected();                       // moonroomcashd's work queue was full
+
+private:
+    void    decrease();
+
+    int     current;
+    int     minLimit;
+    int     maxLimit;
+
+    int     sinceChange     = 0;        // Replies since the limit last changed
+    double  average         = 0;        // Moving average of the latency per item, in ms
+    double  baseline        = 0;        // Lowest latency per item seen lately, in ms
+    double  roundTrip       = 0;        // Moving average of the whole reply time, in ms
+
+    QElapsedTimer   lastDecrease;
+};
+
+#endif // CONCURRENCYLIMITER_H
@@ -3,6 +3,8 @@
 #include "settings.h"
 #include "ui_connection.h"
 #include "rpc.h"
+#include "jsonstream.h"
+#include "blocknotifier.h"
 
 #include "precompiled.h"
 
@@ -316,13 +318,17 @@ bool ConnectionLoader::startEmbeddedMoonroomcashd() {
         processStdErrOutput.append(output);
     });
 
+    // Have moonroomcashd tell us about new blocks right away, instead of waiting to be polled
+    QStringList args;
+    args << "-blocknotify=" % BlockNotifier::blockNotifyCommand();
+
 #ifdef Q_OS_LINUX
-    emoonroomcashd->start(moonroomcashdProgram);
+    emoonroomcashd->start(moonroomcashdProgram, args);
 #elif defined(Q_OS_DARWIN)
-    emoonroomcashd->start(moonroomcashdProgram);
+    emoonroomcashd->start(moonroomcashdProgram, args);
 #else
     emoonroomcashd->setWorkingDirectory(appPath.absolutePath());
-    emoonroomcashd->start("moonroomcashd.exe");
+    emoonroomcashd->start("moonroomcashd.exe", args);
 #endif // Q_OS_LINUX
 
 
@@ -366,40 +372,54 @@ void ConnectionLoader::doRPCSetConnection(Connection* conn) {
     delete this;
 }
 
-Connection* ConnectionLoader::makeConnection(std::shared_ptr<ConnectionConfig> config) {
-    QNetworkAccessManager* client = new QNetworkAccessManager(main);
-         
+static QNetworkRequest makeRequest(const QString& host, int port, const QString& user, const QString& password) {
     QUrl myurl;
     myurl.setScheme("http");
-    myurl.setHost(config.get()->host);
-    myurl.setPort(config.get()->port.toInt());
+    myurl.setHost(host);
+    myurl.setPort(port);
 
-    QNetworkRequest* request = new QNetworkRequest();
-    request->setUrl(myurl);
-    request->setHeader(QNetworkRequest::ContentTypeHeader, "text/plain");
+    QNetworkRequest request;
+    request.setUrl(myurl);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "text/plain");
     
-    QString userpass = config.get()->rpcuser % ":" % config.get()->rpcpassword;
+    QString userpass = user % ":" % password;
     QString headerData = "Basic " + userpass.toLocal8Bit().toBase64();
-    request->setRawHeader("Authorization", headerData.toLocal8Bit());    
+    request.setRawHeader("Authorization", headerData.toLocal8Bit());    
 
-    return new Connection(main, client, request, config);
+    return request;
+}
+
+Connection* ConnectionLoader::makeConnection(std::shared_ptr<ConnectionConfig> config) {
+    QNetworkRequest* request = new QNetworkRequest(makeRequest(config.get()->host, config.get()->port.toInt(),
+                                                               config.get()->rpcuser, config.get()->rpcpassword));
+
+    // The replicas the reads can also go to, see NodePool
+    QList<QNetworkRequest> replicas;
+    for (auto replica : Settings::getInstance()->getRPCReplicas()) {
+        QUrl url("http://" % replica.trimmed());
+        if (!url.isValid() || url.host().isEmpty() || url.port() <= 0) {
+            main->logger->write("Ignoring replica " % url.host() % ", it isn't user:password@host:port");
+            continue;
+        }
+
+        replicas.push_back(makeRequest(url.host(), url.port(), url.userName(), url.password()));
+    }
+
+    return new Connection(main, request, config, replicas);
 }
 
 void ConnectionLoader::refreshMoonroomcashdState(Connection* connection, std::function<void(void)> refused) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "getinfo"}
-    };
+    json payload = RPCMethods::payload<RPCMethods::GetInfo>();
     connection->doRPC(payload,
         [=] (auto) {
             // Success, hide the dialog if it was shown. 
             d->hide();
             this->doRPCSetConnection(connection);
         },
-        [=] (auto reply, auto res) {            
+        [=] (const RPCError& error) {            
             // Failed, see what it is. 
-            auto err = reply->error();
+            auto err = error.code;
+            json res = error.body;
             //qDebug() << err << ":" << QString::fromStdString(res.dump());
 
             if (err == QNetworkReply::NetworkError::ConnectionRefusedError) {   
@@ -589,63 +609,696 @@ std::shared_ptr<ConnectionConfig> ConnectionLoader::loadFromSettings() {
 /***********************************************************************************
  *  Connection Class
  ************************************************************************************/ 
-Connection::Connection(MainWindow* m, QNetworkAccessManager* c, QNetworkRequest* r, 
-                        std::shared_ptr<ConnectionConfig> conf) {
-    this->restclient  = c;
+Connection::Connection(MainWindow* m, QNetworkRequest* r, std::shared_ptr<ConnectionConfig> conf,
+                       const QList<QNetworkRequest>& replicas) {
+    this->worker      = new RPCWorker();
     this->request     = r;
     this->config      = conf;
     this->main        = m;
+    this->batchSize   = Settings::getInstance()->getRPCBatchSize();
+    this->breaker     = new CircuitBreaker([=] () { sendHeartbeat(); });
+    this->pool        = new NodePool(*r, replicas, [=] (int node) { sendHealthCheck(node); });
+    this->stats       = new RPCStats();
+    this->prefetcher  = new Prefetcher([=] (const QList<json>& payloads) { prefetch(payloads); },
+                                       [=] (const QString& method) { stats->recordPrefetchExpired(method); });
 }
 
 Connection::~Connection() {
-    delete restclient;
+    delete worker;
+    delete prefetcher;
+    delete stats;
+    delete pool;
+    delete breaker;
     delete request;
 }
 
-void Connection::doRPC(const json& payload, const std::function<void(json)>& cb, 
-                       const std::function<void(QNetworkReply*, const json&)>& ne) {
+RPCHandle Connection::newHandle() {
+    RPCHandle handle;
+    handle.onCancel(worker->canceller());
+    return handle;
+}
+
+RPCHandle Connection::doRPC(const json& payload, const std::function<void(json)>& cb, 
+                            const std::function<void(const RPCError&)>& ne) {
+    RPCHandle handle = newHandle();
+    sendOne(payload, handle, [=] (json& result) -> std::function<void(void)> {
+        json moved = std::move(result);
+        return [=] () mutable {
+            if (shutdownInProgress || handle.isCancelled()) {
+                // Ignoring callback because shutdown in progress, or nobody is waiting for it
+                return;
+            }
+            cb(std::move(moved));
+        };
+    }, handle.unlessCancelled(ne));
+    return handle;
+}
+
+static QString methodOf(const json& payload) {
+    auto method = payload.find("method");
+    if (method == payload.end() || !method->is_string())
+        return QString();
+
+    return QString::fromStdString(method->get<json::string_t>());
+}
+
+/**
+ * See RPCMethods::priority and RPCMethods::timeout. A batch goes in the most urgent class of its calls,
+ * and waits as long as its slowest call, plus a bit for each call in it. It is only sent again if all
+ * of its calls are read only.
+ */
+static SendOptions optionsFor(const QList<json>& payloads) {
+    SendOptions options;
+    options.priority   = payloads.isEmpty() ? Refresh : Unbounded;
+    options.items      = payloads.size();
+    options.idempotent = true;
+
+    bool forever = false;
+    int  longest = 0;
+    for (auto& payload : payloads) {
+        QString method = methodOf(payload);
+
+        auto priority = RPCMethods::priority(method);
+        if (priority < options.priority)
+            options.priority = priority;
+
+        int timeout = RPCMethods::timeout(method);
+        if (timeout == 0)
+            forever = true;
+        else if (timeout > longest)
+            longest = timeout;
+
+        if (!RPCMethods::isShareable(method))
+            options.idempotent = false;
+    }
+
+    options.timeout = forever ? 0 : longest + 100 * (payloads.size() - 1);
+
+    if (Tracer::isEnabled())
+        options.trace = Tracer::getInstance()->newId();
+
+    return options;
+}
+
+// Only a batch of reads that any node can answer goes to a replica. See NodePool.
+static bool replicable(const QList<json>& payloads) {
+    for (auto& payload : payloads) {
+        if (!RPCMethods::isReplicable(methodOf(payload)))
+            return false;
+    }
+
+    return !payloads.isEmpty();
+}
+
+// How many calls of each method are in the payloads
+static QMap<QString, int> callsIn(const QList<json>& payloads) {
+    QMap<QString, int> calls;
+    for (auto& payload : payloads) {
+        calls[methodOf(payload)]++;
+    }
+
+    return calls;
+}
+
+/**
+ * Let the node pool, the circuit breaker if it went to the primary, and the stats know how the request
+ * went, once its result is back on the UI thread. calls and sent are what recordStats needs. A slow
+ * call that timed out isn't given to the breaker, see RPCMethods::timeoutMeansDown.
+ *
+ * If it is traced, the request is one span from here to when its result has run, named after its methods.
+ */
+template<class Handler>
+Handler Connection::watched(int node, quint64 trace, const QMap<QString, int>& calls, qint64 sent, const Handler& handler) {
+    pool->started(node);
+
+    QString name;
+    if (trace != 0) {
+        name = QStringList(calls.keys()).join(",");
+        Tracer::getInstance()->begin("rpc", name, trace);
+    }
+
+    // A slow call timing out says nothing about moonroomcashd being down
+    bool timeoutCounts = true;
+    for (auto& method : calls.keys()) {
+        if (!RPCMethods::timeoutMeansDown(method))
+            timeoutCounts = false;
+    }
+
+    return [=] (const RPCError& error, auto& body) -> std::function<void(void)> {
+        auto result = handler(error, body);
+        return [=] () {
+            pool->finished(node, error, error.ms);
+            if (node == NodePool::primary && (timeoutCounts || error.code != QNetworkReply::TimeoutError))
+                breaker->record(error);
+            recordStats(calls, sent, error);
+            if (result) {
+                Tracer::Span span("ui", name, trace);
+                result();
+            }
+            if (trace != 0)
+                Tracer::getInstance()->end("rpc", name, trace);
+        };
+    };
+}
+
+// The bytes of a batch are split over its methods by how many calls each had in it
+void Connection::recordStats(const QMap<QString, int>& calls, qint64 sent, const RPCError& error) {
+    if (error.code == QNetworkReply::OperationCanceledError)
+        return;
+
+    int total = 0;
+    for (auto n : calls) {
+        total += n;
+    }
+
+    for (auto it = calls.constBegin(); it != calls.constEnd(); it++) {
+        stats->record(it.key(), it.value(), error.ms, sent * it.value() / total, error.received * it.value() / total,
+                      error.code != QNetworkReply::NoError, error.retries);
+    }
+}
+
+/**
+ * While moonroomcashd isn't answering, fail everything but the interactive requests right away,
+ * without sending them. Returns true if the request was refused.
+ */
+bool Connection::refused(const SendOptions& options, const std::function<void(const RPCError&)>& ne) {
+    if (breaker->allows(options.priority))
+        return false;
+
+    RPCError error { QNetworkReply::ServiceUnavailableError, "moonroomcashd is not responding", json() };
+    QTimer::singleShot(0, main, [=] () {
+        if (shutdownInProgress)
+            return;
+        ne(error);
+    });
+    return true;
+}
+
+/**
+ * Serialize the payload into out with "id" added to it. The payload is written as it is and the id
+ * spliced in before its closing brace, so the request is neither copied nor dumped into a std::string.
+ */
+static void appendStamped(const json& payload, quint64 id, QByteArray& out) {
+    if (!payload.is_object() || payload.empty() || payload.find("id") != payload.end()) {
+        json stamped = payload;
+        stamped["id"] = id;
+        FastJson::dump(stamped, out);
+        return;
+    }
+
+    FastJson::dump(payload, out);
+    out.chop(1);
+    out.append(",\"id\":").append(QByteArray::number(id)).append('}');
+}
+
+// Sent by the circuit breaker to find out when moonroomcashd is back
+void Connection::sendHeartbeat() {
+    json payload = RPCMethods::payload<RPCMethods::GetBlockCount>();
+
+    SendOptions options = optionsFor(QList<json>{ payload });
+    options.priority   = Interactive;
+    options.idempotent = false;         // The breaker sends the next one
+
+    QByteArray body;
+    appendStamped(payload, newRequestId(), body);
+
+    worker->post(*request, body, options, watched(NodePool::primary, options.trace, callsIn(QList<json>{ payload }), body.size(),
+                 ReplyHandler([=] (const RPCError&, json&) {
+        return [=] () {};
+    })));
+}
+
+// Sent by the node pool to see if the node is up, and how far along the chain it is
+void Connection::sendHealthCheck(int node) {
+    if (shutdownInProgress)
+        return;
+
+    json payload = RPCMethods::payload<RPCMethods::GetBlockCount>();
+
+    // Not counted with the other requests, and not sent again, the next check goes out soon enough
+    SendOptions options = optionsFor(QList<json>{ payload });
+    options.priority   = Unbounded;
+    options.idempotent = false;
+
+    QByteArray body;
+    appendStamped(payload, newRequestId(), body);
+
+    worker->post(pool->request(node), body, options, ReplyHandler([=] (const RPCError& error, json& parsed) {
+        int height = -1;
+        if (error.code == QNetworkReply::NoError && parsed.is_object()) {
+            auto result = parsed.find("result");
+            if (result != parsed.end() && result->is_number_integer())
+                height = result->get<int>();
+        }
+
+        return std::function<void(void)>([=] () {
+            pool->checked(node, height);
+        });
+    }));
+}
+
+/**
+ * Send a single request. On the network thread, the reply is parsed and its "result" is given to
+ * the decoder. What the decoder returns is run on the UI thread.
+ */
+void Connection::sendOne(const json& payload, const RPCHandle& handle, 
+                         const std::function<std::function<void(void)>(json&)>& decode,
+                         const std::function<void(const RPCError&)>& ne) {
     if (shutdownInProgress) {
         // Ignoring RPC because shutdown in progress
         return;
     }
 
-    QNetworkReply *reply = restclient->post(*request, QByteArray::fromStdString(payload.dump()));
+    SendOptions options = optionsFor(QList<json>{ payload });
+    options.handle = handle;
 
-    QObject::connect(reply, &QNetworkReply::finished, [=] {
-        reply->deleteLater();
-        if (shutdownInProgress) {
-            // Ignoring callback because shutdown in progress
-            return;
+    int node = pool->pick(replicable(QList<json>{ payload }));
+    if (node == NodePool::primary && refused(options, ne))
+        return;
+
+    // Every request gets its own id, so replies can be matched back to it
+    QByteArray body;
+    appendStamped(payload, newRequestId(), body);
+
+    // If the prefetcher follows this method, it gets a copy of the result too
+    QString method = methodOf(payload);
+    bool    follow = prefetcher->follows(method);
+
+    // The reply is parsed on the network thread, and only the result is passed back
+    worker->post(pool->request(node), body, options, watched(node, options.trace, callsIn(QList<json>{ payload }), body.size(), ReplyHandler(
+                 [=] (const RPCError& error, json& parsed) -> std::function<void(void)> {
+        if (error.code != QNetworkReply::NoError) {
+            return [=] () {
+                if (shutdownInProgress)
+                    return;
+                ne(error);
+            };
         }
-        
-        if (reply->error() != QNetworkReply::NoError) {
-            auto parsed = json::parse(reply->readAll(), nullptr, false);
-            ne(reply, parsed);
-            
-            return;
-        } 
-        
-        auto parsed = json::parse(reply->readAll(), nullptr, false);
+
         if (parsed.is_discarded()) {
-            ne(reply, "Unknown error");
+            RPCError unknown { QNetworkReply::UnknownContentError, "Unknown error", "Unknown error" };
+            return [=] () {
+                if (shutdownInProgress)
+                    return;
+                ne(unknown);
+            };
         }
-        
-        cb(parsed["result"]);        
+
+        if (!follow)
+            return decode(parsed["result"]);
+
+        json observed = parsed["result"];
+        auto result   = decode(parsed["result"]);
+        return [=] () {
+            if (!shutdownInProgress)
+                prefetcher->observe(method, observed);
+            if (result)
+                result();
+        };
+    })));
+}
+
+RPCHandle Connection::doRPCArray(const QList<json>& payloads, const std::function<void(QList<json>)>& cb,
+                                 const std::function<void(const RPCError&)>& ne) {
+    RPCHandle handle = newHandle();
+    sendArray(payloads, handle, [=] (QList<json>& replies) -> std::function<void(void)> {
+        QList<json> results = std::move(replies);
+        return [=] () mutable {
+            if (shutdownInProgress || handle.isCancelled())
+                return;
+            cb(std::move(results));
+        };
+    }, handle.unlessCancelled(ne));
+    return handle;
+}
+
+/**
+ * Send the payloads as one JSON-RPC batch. On the network thread, the replies are parsed, put back
+ * in the order of the payloads and given to the decoder. What the decoder returns is run on the UI thread.
+ */
+void Connection::sendArray(const QList<json>& payloads, const RPCHandle& handle, 
+                           const std::function<std::function<void(void)>(QList<json>&)>& decode,
+                           const std::function<void(const RPCError&)>& ne) {
+    if (shutdownInProgress) {
+        // Ignoring RPC because shutdown in progress
+        return;
+    }
+
+    if (payloads.isEmpty()) {
+        QList<json> none;
+        decode(none)();
+        return;
+    }
+
+    SendOptions options = optionsFor(payloads);
+    options.handle = handle;
+
+    int node = pool->pick(replicable(payloads));
+    if (node == NodePool::primary && refused(options, ne))
+        return;
+
+    QMap<quint64, int> positions;
+    QByteArray batch = stampBatch(payloads, positions);
+
+    QList<QString> methods;
+    for (auto& payload : payloads) {
+        methods.push_back(methodOf(payload));
+    }
+
+    int count = payloads.size();
+    worker->post(pool->request(node), batch, options, watched(node, options.trace, callsIn(payloads), batch.size(), ReplyHandler(
+                 [=] (const RPCError& error, json& parsed) -> std::function<void(void)> {
+        if (error.code != QNetworkReply::NoError || parsed.is_discarded() || !parsed.is_array()) {
+            RPCError failed = error;
+            if (error.code == QNetworkReply::NoError) {
+                failed = RPCError { QNetworkReply::UnknownContentError, "Unknown error", "Unknown error" };
+            }
+
+            return [=] () {
+                if (shutdownInProgress)
+                    return;
+                ne(failed);
+            };
+        }
+
+        // Anything that didn't come back is reported as an error for that item
+        json missing = { {"result", nullptr}, {"error", {{"message", "No reply from moonroomcashd"}}} };
+
+        QList<json> replies;
+        for (int i = 0; i < count; i++) {
+            replies.push_back(missing);
+        }
+
+        for (auto& it : parsed) {
+            if (!it.is_object() || it.find("id") == it.end() || !it["id"].is_number_unsigned())
+                continue;
+
+            auto id = it["id"].get<json::number_unsigned_t>();
+            if (positions.contains(id)) {
+                replies[positions[id]] = std::move(it);
+            }
+        }
+
+        // The calls in the batch can fail on their own
+        QMap<QString, int> failedCalls;
+        for (int i = 0; i < count; i++) {
+            auto callError = replies[i].find("error");
+            if (callError != replies[i].end() && !callError->is_null())
+                failedCalls[methods[i]]++;
+        }
+
+        auto result = decode(replies);
+        if (failedCalls.isEmpty())
+            return result;
+
+        return [=] () {
+            for (auto it = failedCalls.constBegin(); it != failedCalls.constEnd(); it++) {
+                stats->recordErrors(it.key(), it.value());
+            }
+            if (result)
+                result();
+        };
+    })));
+}
+
+/**
+ * Send the payloads as one JSON-RPC batch, and decode the replies into records on the network thread.
+ * The reply is decoded as it arrives with JsonStream, unless simdjson is built in, which is faster
+ * but needs the whole reply at once.
+ */
+void Connection::sendRecords(const QList<json>& payloads, const RPCHandle& handle, 
+                             const std::function<std::function<void(void)>(QList<BatchReply>&)>& decode,
+                             const std::function<void(const RPCError&)>& ne) {
+    if (shutdownInProgress) {
+        // Ignoring RPC because shutdown in progress
+        return;
+    }
+
+    SendOptions options = optionsFor(payloads);
+    options.handle = handle;
+
+    int node = pool->pick(replicable(payloads));
+    if (node == NodePool::primary && refused(options, ne))
+        return;
+
+    QMap<quint64, int> positions;
+    QByteArray batch = stampBatch(payloads, positions);
+
+    auto failed = [=] (const RPCError& error) -> std::function<void(void)> {
+        RPCError failure = error;
+        if (error.code == QNetworkReply::NoError) {
+            failure = RPCError { QNetworkReply::UnknownContentError, "Unknown error", "Unknown error" };
+        }
+
+        return [=] () {
+            if (shutdownInProgress)
+                return;
+            ne(failure);
+        };
+    };
+
+    if (FastJson::hasSimd()) {
+        worker->postRaw(pool->request(node), batch, options, watched(node, options.trace, callsIn(payloads), batch.size(), RawReplyHandler(
+                        [=] (const RPCError& error, const QByteArray& body) -> std::function<void(void)> {
+            QList<BatchReply> replies;
+            if (error.code != QNetworkReply::NoError || !FastJson::decodeBatch(body, positions, replies))
+                return failed(error);
+
+            return decode(replies);
+        })));
+        return;
+    }
+
+    auto stream = std::make_shared<JsonStream>();
+    worker->postStream(pool->request(node), batch, options, [=] (const QByteArray& chunk) {
+        stream->feed(chunk);
+    }, watched(node, options.trace, callsIn(payloads), batch.size(), RawReplyHandler([=] (const RPCError& error, const QByteArray&) -> std::function<void(void)> {
+        QList<BatchReply> replies;
+        if (error.code != QNetworkReply::NoError || !stream->finish(positions, replies))
+            return failed(error);
+
+        return decode(replies);
+    })));
+}
+
+/**
+ * Stamp each payload with a unique id, and remember where it was in the list, since the server
+ * is free to return the batch replies in any order. Returns the batch as a JSON array.
+ */
+QByteArray Connection::stampBatch(const QList<json>& payloads, QMap<quint64, int>& positions) {
+    QByteArray batch;
+    batch.reserve(payloads.size() * 128);
+
+    batch.append('[');
+    for (int i = 0; i < payloads.size(); i++) {
+        auto id = newRequestId();
+        positions[id] = i;
+
+        if (i > 0)
+            batch.append(',');
+        appendStamped(payloads[i], id, batch);
+    }
+    batch.append(']');
+
+    return batch;
+}
+
+RPCHandle Connection::doGet(const QUrl& url, const std::function<void(json)>& cb, const std::function<void(const RPCError&)>& ne) {
+    RPCHandle handle = newHandle();
+    if (shutdownInProgress) {
+        return handle;
+    }
+
+    QNetworkRequest req;
+    req.setUrl(url);
+
+    worker->get(req, handle, [=] (const RPCError& error, json& parsed) -> std::function<void(void)> {
+        if (error.code != QNetworkReply::NoError || parsed.is_discarded()) {
+            RPCError failed = error;
+            if (error.code == QNetworkReply::NoError) {
+                failed = RPCError { QNetworkReply::UnknownContentError, "Unknown error", "Unknown error" };
+            }
+
+            return [=] () {
+                if (shutdownInProgress || handle.isCancelled())
+                    return;
+                ne(failed);
+            };
+        }
+
+        json body = std::move(parsed);
+        return [=] () mutable {
+            if (shutdownInProgress || handle.isCancelled())
+                return;
+            cb(std::move(body));
+        };
     });
+    return handle;
 }
 
-void Connection::doRPCWithDefaultErrorHandling(const json& payload, const std::function<void(json)>& cb) {
-    doRPC(payload, cb, [=] (auto reply, auto parsed) {
-        if (!parsed.is_discarded() && !parsed["error"]["message"].is_null()) {
-            this->showTxError(QString::fromStdString(parsed["error"]["message"]));    
-        } else {
-            this->showTxError(reply->errorString());
+/**
+ * The key that identifies a request in the in-flight list. Read only methods are keyed by the method
+ * and params, so identical requests share a single call. Everything else gets a unique key, so it is 
+ * always sent.
+ */
+QString Connection::requestKey(const json& payload) {
+    QString method = QString::fromStdString(payload["method"].get<json::string_t>());
+    if (!RPCMethods::isShareable(method)) {
+        return "#" % QString::number(newRequestId());
+    }
+
+    QString params = payload.find("params") == payload.end() ? "" : QString::fromStdString(payload["params"].dump());
+    return method % ":" % params;
+}
+
+/**
+ * Add the callback to the in-flight request with this key. Returns true if this is a new
+ * request that needs to be sent, false if it is already in flight.
+ */
+bool Connection::addInFlight(const QString& key, quint64 waiter, const InFlightCallback& cb) {
+    bool isNew = !inFlight.contains(key);
+    inFlight[key].push_back(InFlightWaiter{ waiter, cb });
+
+    return isNew;
+}
+
+// Complete the request with this key, if it is still the one that went out in chunk
+void Connection::completeInFlight(const QString& key, const std::shared_ptr<InFlightChunk>& chunk,
+                                  const RPCError& error, const json& result) {
+    if (inFlightChunks.value(key) != chunk)
+        return;
+
+    inFlightChunks.remove(key);
+    auto waiters = inFlight.take(key);
+    for (auto& waiter : waiters) {
+        waiter.cb(error, result);
+    }
+}
+
+/**
+ * A caller cancelled, so it stops waiting for these requests. The requests others still wait for
+ * carry on. A chunk that nobody waits for anymore is aborted.
+ */
+void Connection::detachInFlight(quint64 waiter, const QList<QString>& keys) {
+    for (auto& key : keys) {
+        auto it = inFlight.find(key);
+        if (it == inFlight.end())
+            continue;
+
+        for (auto w = it->begin(); w != it->end(); ) {
+            if (w->id == waiter)
+                w = it->erase(w);
+            else
+                ++w;
+        }
+
+        if (!it->isEmpty())
+            continue;
+
+        inFlight.erase(it);
+        auto chunk = inFlightChunks.take(key);
+        if (chunk == nullptr)
+            continue;
+
+        bool waited = false;
+        for (auto& other : chunk->keys) {
+            if (inFlightChunks.value(other) == chunk)
+                waited = true;
         }
+
+        if (!waited)
+            chunk->handle.cancel();
+    }
+}
+
+/**
+ * Send the in-flight requests as JSON-RPC batches, and complete them as the replies come in. 
+ * A call that moonroomcashd answered with an error is completed with an InternalServerError, whose
+ * body is the reply, so errorMessage() is moonroomcashd's. Each batch has its own handle, which is
+ * only cancelled once nobody waits for any of its requests, see detachInFlight.
+ */
+void Connection::sendInFlight(const QList<json>& payloads, const QList<QString>& keys) {
+    for (int start = 0; start < payloads.size(); start += batchSize) {
+        QList<json> chunkPayloads = payloads.mid(start, batchSize);
+
+        auto chunk = std::make_shared<InFlightChunk>();
+        chunk->handle = newHandle();
+        chunk->keys   = keys.mid(start, batchSize);
+        for (auto& key : chunk->keys) {
+            inFlightChunks[key] = chunk;
+        }
+
+        sendArray(chunkPayloads, chunk->handle, [=] (QList<json>& replies) -> std::function<void(void)> {
+            QList<json> results = std::move(replies);
+            return [=] () mutable {
+                if (shutdownInProgress)
+                    return;
+
+                // Start what follows from these replies, without waiting for the rest of the batch
+                for (int i = 0; i < chunkPayloads.size(); i++) {
+                    QString method = methodOf(chunkPayloads[i]);
+                    if (prefetcher->follows(method) && results[i].find("result") != results[i].end() &&
+                            results[i]["error"].is_null())
+                        prefetcher->observe(method, results[i]["result"]);
+                }
+
+                RPCError ok { QNetworkReply::NoError, QString(), json() };
+                for (int i = 0; i < chunk->keys.size(); i++) {
+                    json& r = results[i];
+                    if (r.find("result") == r.end() || !r["error"].is_null()) {
+                        RPCError failed { QNetworkReply::InternalServerError, "moonroomcashd returned an error", r };
+                        completeInFlight(chunk->keys[i], chunk, failed, json());
+                    } else {
+                        completeInFlight(chunk->keys[i], chunk, ok, r["result"]);
+                    }
+                }
+            };
+        }, [=] (const RPCError& error) {
+            for (auto key : chunk->keys) {
+                completeInFlight(key, chunk, error, json());
+            }
+        });
+    }
+}
+
+/**
+ * Send the calls the prefetcher asked for, unless they are in flight already or were just prefetched.
+ * Their replies go into the prefetcher, where doBatchRPC picks them up.
+ */
+void Connection::prefetch(const QList<json>& payloads) {
+    if (shutdownInProgress)
+        return;
+
+    // The prefetcher never cancels, so its requests are only aborted along with the connection
+    quint64         waiter = newRequestId();
+    QList<json>     toSend;
+    QList<QString>  keys;
+    for (auto& payload : payloads) {
+        QString key    = requestKey(payload);
+        QString method = QString::fromStdString(payload["method"].get<json::string_t>());
+        if (inFlight.contains(key) || prefetcher->has(key))
+            continue;
+
+        addInFlight(key, waiter, [=] (const RPCError& error, const json& result) {
+            // Failed calls are left for the refresh to send again
+            if (error.code == QNetworkReply::NoError)
+                prefetcher->put(key, method, result);
+        });
+        toSend.push_back(payload);
+        keys.push_back(key);
+    }
+
+    sendInFlight(toSend, keys);
+}
+
+RPCHandle Connection::doRPCWithDefaultErrorHandling(const json& payload, const std::function<void(json)>& cb) {
+    return doRPC(payload, cb, [=] (const RPCError& error) {
+        this->showTxError(error.errorMessage());
     });
 }
 
-void Connection::doRPCIgnoreError(const json& payload, const std::function<void(json)>& cb) {
-    doRPC(payload, cb, [=] (auto, auto) {
+RPCHandle Connection::doRPCIgnoreError(const json& payload, const std::function<void(json)>& cb) {
+    return doRPC(payload, cb, [=] (const RPCError&) {
         // Ignored error handling
     });
 }
@@ -665,8 +1318,9 @@ void Connection::showTxError(const QString& error) {
 }
 
 /**
- * Prevent all future calls from going through
+ * Prevent all future calls from going through, and drop or abort the ones already sent
  */ 
 void Connection::shutdown() {
     shutdownInProgress = true;
+    worker->cancelAll();
 }
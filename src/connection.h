@@ -4,6 +4,15 @@
 #include "mainwindow.h"
 #include "ui_connection.h"
 #include "precompiled.h"
+#include "rpcworker.h"
+#include "fastjson.h"
+#include "rpcmethods.h"
+#include "promise.h"
+#include "circuitbreaker.h"
+#include "rpchandle.h"
+#include "nodepool.h"
+#include "prefetcher.h"
+#include "rpcstats.h"
 
 using json = nlohmann::json;
 
@@ -82,100 +91,269 @@ private:
 /**
  * Represents a connection to a moonroomcashd. It may even start a new moonroomcashd if needed.
  * This is also a UI class, so it may show a dialog waiting for the connection.
+ * The reads may also be spread over other nodes, see NodePool.
 */
 class Connection {
 public:
-    Connection(MainWindow* m, QNetworkAccessManager* c, QNetworkRequest* r, std::shared_ptr<ConnectionConfig> conf);
+    Connection(MainWindow* m, QNetworkRequest* r, std::shared_ptr<ConnectionConfig> conf,
+               const QList<QNetworkRequest>& replicas = QList<QNetworkRequest>());
     ~Connection();
 
-    QNetworkAccessManager*              restclient;
+    RPCWorker*                          worker;
     QNetworkRequest*                    request;
     std::shared_ptr<ConnectionConfig>   config;
     MainWindow*                         main;
 
     void shutdown();
 
-    void doRPC(const json& payload, const std::function<void(json)>& cb, 
-               const std::function<void(QNetworkReply*, const json&)>& ne);
-    void doRPCWithDefaultErrorHandling(const json& payload, const std::function<void(json)>& cb);
-    void doRPCIgnoreError(const json& payload, const std::function<void(json)>& cb) ;
+    // False while moonroomcashd isn't answering. See CircuitBreaker.
+    bool isResponding() { return !breaker->isOpen(); }
+    void setOnRecovered(const std::function<void(void)>& fn) { breaker->setOnRecovered(fn); }
+
+    // Keep the reads on the primary until the replicas have caught up with a change to the wallet. See NodePool.
+    void pinReadsToPrimary() { pool->pinPrimary(); }
+
+    // How long each RPC method takes, and how often it is called
+    RPCStats* getStats() { return stats; }
+
+    // Send the calls rule returns as soon as a reply to method comes in. See Prefetcher.
+    void prefetchAfter(const QString& method, const Prefetcher::Rule& rule) { prefetcher->addRule(method, rule); }
+
+    // All of these return an RPCHandle that cancels the request. See rpchandle.h
+    RPCHandle doRPC(const json& payload, const std::function<void(json)>& cb, 
+                    const std::function<void(const RPCError&)>& ne);
+    RPCHandle doRPCWithDefaultErrorHandling(const json& payload, const std::function<void(json)>& cb);
+    RPCHandle doRPCIgnoreError(const json& payload, const std::function<void(json)>& cb) ;
+
+    // Call a method described in rpcmethods.h. The result is decoded into M::Result on the network
+    // thread, and a reply that doesn't decode goes to ne, like any other error.
+    template<class M>
+    RPCHandle call(const typename M::Params& params, std::function<void(typename M::Result)> cb,
+                   const std::function<void(const RPCError&)>& ne) {
+        QString   method = M::name();
+        RPCHandle handle = newHandle();
+        sendOne(RPCMethods::payload<M>(params), handle, [=] (json& result) -> std::function<void(void)> {
+            auto decoded = std::make_shared<typename M::Result>();
+            if (!M::decode(result, *decoded)) {
+                RPCError unexpected { QNetworkReply::UnknownContentError, "Unexpected reply to " % method, json() };
+                return [=] () {
+                    if (shutdownInProgress || handle.isCancelled())
+                        return;
+                    ne(unexpected);
+                };
+            }
+
+            return [=] () {
+                if (shutdownInProgress || handle.isCancelled())
+                    return;
+                cb(std::move(*decoded));
+            };
+        }, handle.unlessCancelled(ne));
+        return handle;
+    }
+
+    template<class M>
+    RPCHandle callWithDefaultErrorHandling(const typename M::Params& params, std::function<void(typename M::Result)> cb) {
+        return call<M>(params, cb, [=] (const RPCError& error) {
+            this->showTxError(error.errorMessage());
+        });
+    }
+
+    // Same as call, but returns the result as a Future. See promise.h. The call is cancelled along
+    // with owner, and the future then never settles.
+    template<class M>
+    Future<typename M::Result> callAsync(const typename M::Params& params, const RPCHandle& owner = RPCHandle()) {
+        Promise<typename M::Result> promise;
+        owner.adopt(call<M>(params, [=] (typename M::Result result) {
+            promise.resolve(std::move(result));
+        }, [=] (const RPCError& error) {
+            promise.reject(error);
+        }));
+        return promise.future();
+    }
+
+    // Send all the payloads as a single JSON-RPC batch (a JSON array in one HTTP POST). The callback 
+    // gets the full response object ("result", "error", "id") for every payload, in the same order
+    // as the payloads. Responses are matched back to the payloads by their unique request id.
+    RPCHandle doRPCArray(const QList<json>& payloads, const std::function<void(QList<json>)>& cb,
+                         const std::function<void(const RPCError&)>& ne);
+
+    // Send all the payloads as a single JSON-RPC batch. The replies are decoded into records (see BatchReply)
+    // while they are still arriving, so the big lists are never held in memory whole (see JsonStream).
+    // The decoder then runs on the network thread too, so the UI thread only gets the finished result.
+    // The decoder must not touch anything but the replies.
+    template<class R>
+    RPCHandle doRPCArrayRecords(const QList<json>& payloads, std::function<R(QList<BatchReply>&)> decode,
+                                std::function<void(R)> cb, const std::function<void(const RPCError&)>& ne) {
+        RPCHandle handle = newHandle();
+        sendRecords(payloads, handle, [=] (QList<BatchReply>& replies) -> std::function<void(void)> {
+            auto decoded = std::make_shared<R>(decode(replies));
+            return [=] () {
+                if (shutdownInProgress || handle.isCancelled())
+                    return;
+                cb(std::move(*decoded));
+            };
+        }, handle.unlessCancelled(ne));
+        return handle;
+    }
+
+    // GET a JSON document from some other web service
+    RPCHandle doGet(const QUrl& url, const std::function<void(json)>& cb, const std::function<void(const RPCError&)>& ne);
 
     void showTxError(const QString& error);
 
     // Batch method. Note: Because of the template, it has to be in the header file. 
+    // The payloads are sent as JSON-RPC batch arrays of at most batchSize items each, and the callback
+    // is called as soon as the last reply arrives. Requests that are identical to one already in flight 
+    // (same method and params) are not sent again, but share the reply of the in-flight one.
+    // Cancelling the batch only stops its own callback. A request it shares with other callers is
+    // only aborted once all of them have cancelled.
+    // Replies that were prefetched are not sent again.
+    // If any of the calls failed, even after the retries, ne gets the first error instead of cb.
     template<class T>
-    void doBatchRPC(const QList<T>& payloads,
-                     std::function<json(T)> payloadGenerator,
-                     std::function<void(QMap<T, json>*)> cb) {    
-        auto responses = new QMap<T, json>(); // zAddr -> list of responses for each call. 
+    RPCHandle doBatchRPC(const QList<T>& payloads,
+                         std::function<json(T)> payloadGenerator,
+                         std::function<void(QMap<T, json>*)> cb,
+                         const std::function<void(const RPCError&)>& ne) {    
+        RPCHandle handle;
+
         int totalSize = payloads.size();
         if (totalSize == 0)
-            return;
+            return handle;
 
-        // Keep track of all pending method calls, so as to prevent 
-        // any overlapping calls
-        static QMap<QString, bool> inProgress;
+        auto responses = std::make_shared<QMap<T, json>>(); // zAddr -> list of responses for each call. 
+        auto failure   = std::make_shared<RPCError>(RPCError{ QNetworkReply::NoError, QString(), json() });
 
-        QString method = QString::fromStdString(payloadGenerator(payloads[0])["method"]);
-        if (inProgress.value(method, false)) {
-            qDebug() << "In progress batch, skipping";
-            return;
-        }
+        // Number of replies still outstanding. The last one to arrive calls the callback.
+        auto pending = std::make_shared<int>(totalSize);
+        auto fnDone = [=] (const T& item, const RPCError& error, const json& result) {
+            if (error.code == QNetworkReply::NoError)
+                (*responses)[item] = result;
+            else if (failure->code == QNetworkReply::NoError)
+                *failure = error;
+
+            (*pending)--;
+            if (*pending != 0 || handle.isCancelled())
+                return;
+
+            if (failure->code != QNetworkReply::NoError)
+                ne(*failure);
+            else
+                cb(new QMap<T, json>(std::move(*responses)));
+        };
 
+        quint64         waiter = newRequestId();
+        QList<json>     toSend;
+        QList<QString>  keys;
+        QList<QString>  waitingOn;
         for (auto item: payloads) {
             json payload = payloadGenerator(item);
-            inProgress[method] = true;
-            
-            QNetworkReply *reply = restclient->post(*request, QByteArray::fromStdString(payload.dump()));
-
-            QObject::connect(reply, &QNetworkReply::finished, [=] {
-                reply->deleteLater();
-                if (shutdownInProgress) {
-                    // Ignoring callback because shutdown in progress
-                    return;
-                }
-                
-                auto all = reply->readAll();            
-                auto parsed = json::parse(all.toStdString(), nullptr, false);
-
-                if (reply->error() != QNetworkReply::NoError) {            
-                    qDebug() << QString::fromStdString(parsed.dump());
-                    qDebug() << reply->errorString();
-
-                    (*responses)[item] = json::object();    // Empty object
-                } else {
-                    if (parsed.is_discarded()) {
-                        (*responses)[item] = json::object();    // Empty object
-                    } else {
-                        (*responses)[item] = parsed["result"];
-                    }
-                }
-            });
-        }
+            QString key  = requestKey(payload);
 
-        auto waitTimer = new QTimer(main);
-        QObject::connect(waitTimer, &QTimer::timeout, [=]() {
-            if (shutdownInProgress) {
-                waitTimer->stop();
-                waitTimer->deleteLater();  
-                return;
+            json prefetched;
+            if (prefetcher->take(key, prefetched)) {
+                stats->recordPrefetched(QString::fromStdString(payload["method"].get<json::string_t>()));
+                fnDone(item, RPCError{ QNetworkReply::NoError, QString(), json() }, prefetched);
+                continue;
             }
 
-            // If all responses have arrived, return
-            if (responses->size() == totalSize) {
-                waitTimer->stop();
-                
-                cb(responses);
-                inProgress[method] = false;
-
-                waitTimer->deleteLater();            
+            waitingOn.push_back(key);
+            if (addInFlight(key, waiter, [=] (const RPCError& error, const json& result) { fnDone(item, error, result); })) {
+                toSend.push_back(payload);
+                keys.push_back(key);
+            } else {
+                stats->recordShared(QString::fromStdString(payload["method"].get<json::string_t>()));
             }
+        }
+
+        sendInFlight(toSend, keys);
+
+        handle.onCancel([=] () {
+            detachInFlight(waiter, waitingOn);
         });
-        waitTimer->start(100);    
+        return handle;
+    }
+
+    // Same as doBatchRPC, but returns the replies as a Future, which fails with the first error.
+    // Unlike doBatchRPC, this also completes when there is nothing to send. The batch is cancelled
+    // along with owner.
+    template<class T>
+    Future<QMap<T, json>> doBatchRPCAsync(const QList<T>& payloads, std::function<json(T)> payloadGenerator,
+                                          const RPCHandle& owner = RPCHandle()) {
+        if (payloads.isEmpty())
+            return Future<QMap<T, json>>::resolved(QMap<T, json>());
+
+        Promise<QMap<T, json>> promise;
+        owner.adopt(doBatchRPC<T>(payloads, payloadGenerator, [=] (QMap<T, json>* replies) {
+            promise.resolve(*replies);
+            delete replies;
+        }, [=] (const RPCError& error) {
+            promise.reject(error);
+        }));
+        return promise.future();
     }
 
 private:
-    bool shutdownInProgress = false;    
+    quint64 newRequestId() { return ++lastRequestId; }
+
+    // A handle that also drops or aborts its requests in the worker when it is cancelled
+    RPCHandle newHandle();
+
+    QByteArray stampBatch(const QList<json>& payloads, QMap<quint64, int>& positions);
+
+    bool    refused(const SendOptions& options, const std::function<void(const RPCError&)>& ne);
+    void    sendHeartbeat();
+    void    sendHealthCheck(int node);
+
+    template<class Handler>
+    Handler watched(int node, quint64 trace, const QMap<QString, int>& calls, qint64 sent, const Handler& handler);
+    void    recordStats(const QMap<QString, int>& calls, qint64 sent, const RPCError& error);
+    void    prefetch(const QList<json>& payloads);
+
+    void    sendOne(const json& payload, const RPCHandle& handle, const std::function<std::function<void(void)>(json&)>& decode,
+                    const std::function<void(const RPCError&)>& ne);
+
+    void    sendArray(const QList<json>& payloads, const RPCHandle& handle, const std::function<std::function<void(void)>(QList<json>&)>& decode,
+                      const std::function<void(const RPCError&)>& ne);
+    void    sendRecords(const QList<json>& payloads, const RPCHandle& handle, const std::function<std::function<void(void)>(QList<BatchReply>&)>& decode,
+                        const std::function<void(const RPCError&)>& ne);
+
+    // A JSON-RPC batch of in-flight requests that went out together
+    struct InFlightChunk {
+        RPCHandle       handle;
+        QList<QString>  keys;
+    };
+
+    // Gets the result of an in-flight request, or why it failed
+    typedef std::function<void(const RPCError& error, const json& result)> InFlightCallback;
+
+    // A caller waiting for an in-flight request. All the calls of one doBatchRPC have the same id.
+    struct InFlightWaiter {
+        quint64             id;
+        InFlightCallback    cb;
+    };
+
+    QString requestKey  (const json& payload);
+    bool    addInFlight (const QString& key, quint64 waiter, const InFlightCallback& cb);
+    void    sendInFlight(const QList<json>& payloads, const QList<QString>& keys);
+    void    completeInFlight(const QString& key, const std::shared_ptr<InFlightChunk>& chunk,
+                             const RPCError& error, const json& result);
+    void    detachInFlight(quint64 waiter, const QList<QString>& keys);
+
+    CircuitBreaker*     breaker;
+    NodePool*           pool;
+    Prefetcher*         prefetcher;
+    RPCStats*           stats;
+
+    bool    shutdownInProgress  = false;    
+    quint64 lastRequestId       = 0;
+    int     batchSize;
+
+    // Requests that have been sent, but not replied to yet, keyed by method + params. Every
+    // caller waiting for that request is in the list, and the chunk it went out in is kept
+    // under the same key.
+    QMap<QString, QList<InFlightWaiter>>            inFlight;
+    QMap<QString, std::shared_ptr<InFlightChunk>>   inFlightChunks;
 };
 
 #endif
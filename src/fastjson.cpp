@@ -0,0 +1,361 @@
+#include "fastjson.h"
+
+#ifdef MRC_USE_SIMDJSON
+#include <simdjson.h>
+#endif
+
+using json = nlohmann::json;
+
+bool FastJson::hasSimd() {
+#ifdef MRC_USE_SIMDJSON
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FastJson::useSimd(Backend backend) {
+    return hasSimd() && backend != DOM;
+}
+
+const char* FastJson::backendName(Backend backend) {
+    return useSimd(backend) ? "simdjson" : "nlohmann::json";
+}
+
+static const char* noReplyError = "{\"message\":\"No reply from moonroomcashd\"}";
+
+static QByteArray toBytes(const ArenaString& s) {
+    return QByteArray(s.data(), (int)s.size());
+}
+
+//
+// nlohmann::json
+//
+
+static QString domString(const ArenaJson& obj, const char* key) {
+    auto it = obj.find(key);
+    if (it == obj.end() || !it->is_string())
+        return QString();
+    auto& value = it->get_ref<const ArenaJson::string_t&>();
+    return QString::fromUtf8(value.data(), (int)value.size());
+}
+
+static double domDouble(const ArenaJson& obj, const char* key) {
+    auto it = obj.find(key);
+    return it != obj.end() && it->is_number() ? it->get<double>() : 0;
+}
+
+static qint64 domInt(const ArenaJson& obj, const char* key, qint64 missing = 0) {
+    auto it = obj.find(key);
+    return it != obj.end() && it->is_number() ? it->get<qint64>() : missing;
+}
+
+static bool domBool(const ArenaJson& obj, const char* key) {
+    auto it = obj.find(key);
+    return it != obj.end() && it->is_boolean() && it->get<bool>();
+}
+
+UnspentRecord FastJson::unspentFromJson(const ArenaJson& it) {
+    UnspentRecord r;
+    r.txid          = domString(it, "txid");
+    r.address       = domString(it, "address");
+    r.memo          = domString(it, "memo");
+    r.amount        = domDouble(it, "amount");
+    r.confirmations = domInt(it, "confirmations");
+    r.spendable     = domBool(it, "spendable");
+    r.vout          = (int)domInt(it, "vout", -1);
+    r.jsindex       = (int)domInt(it, "jsindex", -1);
+    r.jsoutindex    = (int)domInt(it, "jsoutindex", -1);
+    r.outindex      = (int)domInt(it, "outindex", -1);
+    return r;
+}
+
+TxRecord FastJson::txFromJson(const ArenaJson& it) {
+    TxRecord r;
+    r.txid          = domString(it, "txid");
+    r.address       = domString(it, "address");
+    r.category      = domString(it, "category");
+    r.memo          = domString(it, "memo");
+    r.blockhash     = domString(it, "blockhash");
+    r.amount        = domDouble(it, "amount");
+    r.fee           = domDouble(it, "fee");
+    r.confirmations = domInt(it, "confirmations");
+    r.time          = domInt(it, "time");
+    r.vout          = (int)domInt(it, "vout", -1);
+    return r;
+}
+
+static bool isRecordList(const ArenaJson& result) {
+    return result.is_array() && (result.empty() || result[0].is_object());
+}
+
+//
+// simdjson
+//
+
+#ifdef MRC_USE_SIMDJSON
+static simdjson::dom::parser& simdParser() {
+    // The parser keeps its buffers between calls, so there's one for each thread that decodes
+    static thread_local simdjson::dom::parser parser;
+    return parser;
+}
+
+static QString simdString(simdjson::dom::object obj, const char* key) {
+    std::string_view value;
+    if (obj[key].get_string().get(value) != simdjson::SUCCESS)
+        return QString();
+    return QString::fromUtf8(value.data(), (int)value.size());
+}
+
+static double simdDouble(simdjson::dom::object obj, const char* key) {
+    double value;
+    return obj[key].get_double().get(value) == simdjson::SUCCESS ? value : 0;
+}
+
+static qint64 simdInt(simdjson::dom::object obj, const char* key, qint64 missing = 0) {
+    int64_t value;
+    return obj[key].get_int64().get(value) == simdjson::SUCCESS ? value : missing;
+}
+
+static bool simdBool(simdjson::dom::object obj, const char* key) {
+    bool value;
+    return obj[key].get_bool().get(value) == simdjson::SUCCESS && value;
+}
+
+static UnspentRecord unspentFromSimd(simdjson::dom::object it) {
+    UnspentRecord r;
+    r.txid          = simdString(it, "txid");
+    r.address       = simdString(it, "address");
+    r.memo          = simdString(it, "memo");
+    r.amount        = simdDouble(it, "amount");
+    r.confirmations = simdInt(it, "confirmations");
+    r.spendable     = simdBool(it, "spendable");
+    r.vout          = (int)simdInt(it, "vout", -1);
+    r.jsindex       = (int)simdInt(it, "jsindex", -1);
+    r.jsoutindex    = (int)simdInt(it, "jsoutindex", -1);
+    r.outindex      = (int)simdInt(it, "outindex", -1);
+    return r;
+}
+
+static TxRecord txFromSimd(simdjson::dom::object it) {
+    TxRecord r;
+    r.txid          = simdString(it, "txid");
+    r.address       = simdString(it, "address");
+    r.category      = simdString(it, "category");
+    r.memo          = simdString(it, "memo");
+    r.blockhash     = simdString(it, "blockhash");
+    r.amount        = simdDouble(it, "amount");
+    r.fee           = simdDouble(it, "fee");
+    r.confirmations = simdInt(it, "confirmations");
+    r.time          = simdInt(it, "time");
+    r.vout          = (int)simdInt(it, "vout", -1);
+    return r;
+}
+
+static bool simdParse(const QByteArray& body, simdjson::dom::element& doc) {
+    return simdParser().parse(body.constData(), (size_t)body.size()).get(doc) == simdjson::SUCCESS;
+}
+
+static void simdUnspentList(simdjson::dom::array arr, QList<UnspentRecord>& out) {
+    for (simdjson::dom::element e : arr) {
+        simdjson::dom::object obj;
+        if (e.get_object().get(obj) == simdjson::SUCCESS)
+            out.push_back(unspentFromSimd(obj));
+    }
+}
+
+static void simdTxList(simdjson::dom::array arr, QList<TxRecord>& out) {
+    for (simdjson::dom::element e : arr) {
+        simdjson::dom::object obj;
+        if (e.get_object().get(obj) == simdjson::SUCCESS)
+            out.push_back(txFromSimd(obj));
+    }
+}
+#endif // MRC_USE_SIMDJSON
+
+//
+// Decoders
+//
+
+bool FastJson::decodeUnspent(const QByteArray& body, QList<UnspentRecord>& out, Backend backend) {
+#ifdef MRC_USE_SIMDJSON
+    if (useSimd(backend)) {
+        simdjson::dom::element doc;
+        simdjson::dom::array   result;
+        if (!simdParse(body, doc) || doc["result"].get_array().get(result) != simdjson::SUCCESS)
+            return false;
+
+        simdUnspentList(result, out);
+        return true;
+    }
+#endif
+
+    Q_UNUSED(backend);
+    auto parsed = ArenaJson::parse(body.constBegin(), body.constEnd(), nullptr, false);
+    if (parsed.is_discarded() || !parsed.is_object() || parsed.find("result") == parsed.end() || !parsed["result"].is_array())
+        return false;
+
+    for (auto& it : parsed["result"]) {
+        if (it.is_object())
+            out.push_back(unspentFromJson(it));
+    }
+    return true;
+}
+
+bool FastJson::decodeTransactions(const QByteArray& body, QList<TxRecord>& out, Backend backend) {
+#ifdef MRC_USE_SIMDJSON
+    if (useSimd(backend)) {
+        simdjson::dom::element doc;
+        simdjson::dom::array   txs;
+        if (!simdParse(body, doc))
+            return false;
+
+        if (doc["result"].get_array().get(txs) != simdjson::SUCCESS &&
+            doc["result"]["transactions"].get_array().get(txs) != simdjson::SUCCESS)
+            return false;
+
+        simdTxList(txs, out);
+        return true;
+    }
+#endif
+
+    Q_UNUSED(backend);
+    auto parsed = ArenaJson::parse(body.constBegin(), body.constEnd(), nullptr, false);
+    if (parsed.is_discarded() || !parsed.is_object() || parsed.find("result") == parsed.end())
+        return false;
+
+    ArenaJson* txs = &parsed["result"];
+    if (txs->is_object() && txs->find("transactions") != txs->end())
+        txs = &(*txs)["transactions"];
+
+    if (!txs->is_array())
+        return false;
+
+    for (auto& it : *txs) {
+        if (it.is_object())
+            out.push_back(txFromJson(it));
+    }
+    return true;
+}
+
+bool FastJson::decodeBatch(const QByteArray& body, const QMap<quint64, int>& positions,
+                           QList<BatchReply>& out, Backend backend) {
+    // Anything that doesn't come back is reported as an error for that item
+    BatchReply missing;
+    missing.error = noReplyError;
+    for (int i = 0; i < positions.size(); i++) {
+        out.push_back(missing);
+    }
+
+#ifdef MRC_USE_SIMDJSON
+    if (useSimd(backend)) {
+        simdjson::dom::element doc;
+        simdjson::dom::array   replies;
+        if (!simdParse(body, doc) || doc.get_array().get(replies) != simdjson::SUCCESS)
+            return false;
+
+        for (simdjson::dom::element e : replies) {
+            simdjson::dom::object obj;
+            uint64_t id;
+            if (e.get_object().get(obj) != simdjson::SUCCESS || obj["id"].get_uint64().get(id) != simdjson::SUCCESS)
+                continue;
+            if (!positions.contains(id))
+                continue;
+
+            BatchReply reply;
+            simdjson::dom::element error, result;
+            if (obj["error"].get(error) == simdjson::SUCCESS && !error.is_null()) {
+                reply.error = QString::fromStdString(simdjson::to_string(error));
+            } else if (obj["result"].get(result) == simdjson::SUCCESS) {
+                simdjson::dom::array   list;
+                simdjson::dom::object  fields;
+                simdjson::dom::element first;
+                bool isRecords = result.get_array().get(list) == simdjson::SUCCESS &&
+                                 (list.size() == 0 || (list.at(0).get(first) == simdjson::SUCCESS && first.is_object()));
+                if (isRecords) {
+                    simdUnspentList(list, reply.unspent);
+                } else if (result.get_object().get(fields) == simdjson::SUCCESS && 
+                           fields["transactions"].get_array().get(list) == simdjson::SUCCESS) {
+                    // Keep the rest of the object (lastblock) as JSON, but not the txs
+                    json rest = json::object();
+                    for (auto field : fields) {
+                        if (field.key == "transactions") {
+                            rest["transactions"] = json::array();
+                        } else {
+                            rest[std::string(field.key)] = json::parse(simdjson::to_string(field.value), nullptr, false);
+                        }
+                    }
+                    simdTxList(list, reply.transactions);
+                    dump(rest, reply.result);
+                } else {
+                    reply.result = QByteArray::fromStdString(simdjson::to_string(result));
+                }
+            }
+
+            out[positions[id]] = reply;
+        }
+        return true;
+    }
+#endif
+
+    Q_UNUSED(backend);
+    auto parsed = ArenaJson::parse(body.constBegin(), body.constEnd(), nullptr, false);
+    if (parsed.is_discarded() || !parsed.is_array())
+        return false;
+
+    for (auto& it : parsed) {
+        if (!it.is_object() || it.find("id") == it.end() || !it["id"].is_number_unsigned())
+            continue;
+
+        auto id = it["id"].get<ArenaJson::number_unsigned_t>();
+        if (!positions.contains(id))
+            continue;
+
+        BatchReply reply;
+        auto error  = it.find("error");
+        auto result = it.find("result");
+        if (error != it.end() && !error->is_null()) {
+            reply.error = QString::fromUtf8(toBytes(error->dump()));
+        } else if (result != it.end()) {
+            auto txs = result->is_object() ? result->find("transactions") : result->end();
+            if (isRecordList(*result)) {
+                for (auto& item : *result)
+                    reply.unspent.push_back(unspentFromJson(item));
+            } else if (txs != result->end() && txs->is_array()) {
+                for (auto& item : *txs) {
+                    if (item.is_object())
+                        reply.transactions.push_back(txFromJson(item));
+                }
+                *txs = ArenaJson::array();
+                reply.result = toBytes(result->dump());
+            } else {
+                reply.result = toBytes(result->dump());
+            }
+        }
+
+        out[positions[id]] = reply;
+    }
+    return true;
+}
+
+//
+// Serializing
+//
+
+namespace {
+    class ByteArrayOutput : public nlohmann::detail::output_adapter_protocol<char> {
+    public:
+        explicit ByteArrayOutput(QByteArray& out) : out(out) {}
+
+        void write_character(char c) override                           { out.append(c); }
+        void write_characters(const char* s, std::size_t length) override { out.append(s, (int)length); }
+
+    private:
+        QByteArray& out;
+    };
+}
+
+void FastJson::dump(const json& j, QByteArray& out) {
+    nlohmann::detail::serializer<json> serializer(std::make_shared<ByteArrayOutput>(out), ' ');
+    serializer.dump(j, false, false, 0);
+}
@@ -0,0 +1,95 @@
+#ifndef FASTJSON_H
+#define FASTJSON_H
+
+// Kept free of the widget headers, so the benchmark in bench/ can build it on its own
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QMap>
+
+#include "3rdparty/json/json.hpp"
+#include "arena.h"
+
+// A JSON DOM whose nodes and strings come from the current Arena. Only for use while decoding.
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+typedef nlohmann::basic_json<std::map, std::vector, ArenaString, bool, std::int64_t, std::uint64_t, double,
+                             ArenaAllocator> ArenaJson;
+
+// One output from listunspent or one note from z_listunspent
+struct UnspentRecord {
+    QString     txid;
+    QString     address;
+    QString     memo;
+    double      amount          = 0;
+    qint64      confirmations   = 0;
+    bool        spendable       = false;
+    int         vout            = -1;       // Transparent outputs
+    int         jsindex         = -1;       // Sprout notes
+    int         jsoutindex      = -1;
+    int         outindex        = -1;       // Sapling notes
+};
+
+// One entry from listtransactions or listsinceblock
+struct TxRecord {
+    QString     txid;
+    QString     address;
+    QString     category;
+    QString     memo;
+    QString     blockhash;
+    double      amount          = 0;
+    double      fee             = 0;
+    qint64      confirmations   = 0;
+    qint64      time            = 0;
+    int         vout            = -1;
+};
+
+// One reply of a JSON-RPC batch
+struct BatchReply {
+    QString                 error;          // The error as JSON, empty if the call succeeded
+    QByteArray              result;         // The result as JSON, without the records below
+    QList<UnspentRecord>    unspent;        // If the result was a list of objects (listunspent, z_listunspent)
+    QList<TxRecord>         transactions;   // result.transactions (listsinceblock)
+};
+
+/**
+ * Decodes the big RPC replies straight from the reply body into the fields we use, without
+ * building a full DOM of the reply first.
+ *
+ * If the wallet is built with CONFIG+=simdjson, this uses simdjson. Otherwise (or when asked for
+ * explicitly, for eg. by the benchmark) it falls back to nlohmann::json.
+ */
+class FastJson {
+public:
+    enum Backend {
+        Default,
+        DOM,            // nlohmann::json
+        SIMD            // simdjson, if it was built in
+    };
+
+    static bool         hasSimd();
+    static const char*  backendName(Backend backend = Default);
+
+    // The "result" of a listunspent or z_listunspent reply
+    static bool decodeUnspent     (const QByteArray& body, QList<UnspentRecord>& out, Backend backend = Default);
+
+    // The "result" of a listtransactions reply, or "result.transactions" of listsinceblock
+    static bool decodeTransactions(const QByteArray& body, QList<TxRecord>& out, Backend backend = Default);
+
+    // A batch reply. Replies are put in payload order using positions (request id -> index). Results
+    // that are arrays of objects are decoded as unspent outputs and result.transactions as txs, 
+    // everything else is left as JSON.
+    static bool decodeBatch       (const QByteArray& body, const QMap<quint64, int>& positions,
+                                   QList<BatchReply>& out, Backend backend = Default);
+
+    // A single record that was already parsed, for eg. by JsonStream
+    static UnspentRecord    unspentFromJson(const ArenaJson& it);
+    static TxRecord         txFromJson     (const ArenaJson& it);
+
+    // Serialize straight into the request body, without going through a std::string first
+    static void             dump(const nlohmann::json& j, QByteArray& out);
+
+private:
+    static bool useSimd(Backend backend);
+};
+
+#endif // FASTJSON_H
@@ -0,0 +1,193 @@
+#include "jsonstream.h"
+
+void JsonStream::feed(const QByteArray& chunk) {
+    const char* data = chunk.constData();
+    const int   size = chunk.size();
+
+    for (int i = 0; i < size; i++) {
+        char c = data[i];
+
+        // Inside a record, just find where it ends
+        if (recordDepth > 0) {
+            element.append(c);
+
+            if (inString) {
+                if (escaped)            escaped  = false;
+                else if (c == '\\')     escaped  = true;
+                else if (c == '"')      inString = false;
+                continue;
+            }
+
+            if (c == '"') {
+                inString = true;
+            } else if (c == '{' || c == '[') {
+                recordDepth++;
+            } else if (c == '}' || c == ']') {
+                recordDepth--;
+                if (recordDepth == 0)
+                    endRecord();
+            }
+            continue;
+        }
+
+        if (inString) {
+            envelope.append(c);
+
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+                continue;
+            }
+
+            if (!stack.isEmpty() && stack.last().type == '{')
+                lastString.append(c);
+            continue;
+        }
+
+        switch (c) {
+        case ' ': case '\t': case '\r': case '\n':
+            break;
+
+        case '"':
+            startValue();
+            inString = true;
+            lastString.clear();
+            envelope.append(c);
+            break;
+
+        case ':':
+            if (!stack.isEmpty() && stack.last().type == '{')
+                stack.last().key = lastString;
+            envelope.append(c);
+            break;
+
+        case ',':
+            // The records are cut out of their array, so the commas are put back by startValue()
+            if (!stack.isEmpty() && stack.last().type == '[' && stack.last().kind != None) {
+                stack.last().expectValue = true;
+            } else {
+                envelope.append(c);
+            }
+            break;
+
+        case '{':
+            if (!stack.isEmpty() && stack.last().type == '[' && stack.last().kind != None) {
+                stack.last().expectValue = false;
+                recordKind  = stack.last().kind;
+                recordDepth = 1;
+                element.append(c);
+                break;
+            }
+
+            startValue();
+            if (stack.size() == 1 && stack.last().type == '[')
+                replyIndex++;
+
+            stack.push_back(Frame{ '{', None, QByteArray(), false, 0 });
+            envelope.append(c);
+            break;
+
+        case '[': {
+            startValue();
+
+            RecordKind kind = None;
+            if (!stack.isEmpty() && stack.last().type == '{') {
+                if (stack.last().key == "result")               kind = Unspent;
+                else if (stack.last().key == "transactions")    kind = Transaction;
+            }
+
+            stack.push_back(Frame{ '[', kind, QByteArray(), true, 0 });
+            envelope.append(c);
+            break;
+        }
+
+        case '}': case ']':
+            if (!stack.isEmpty())
+                stack.removeLast();
+            envelope.append(c);
+            break;
+
+        default:
+            startValue();
+            envelope.append(c);
+            break;
+        }
+    }
+}
+
+/**
+ * Called at the first char of a value that stays in the envelope. Inside a record array, this
+ * puts back the comma in front of it if it needs one.
+ */
+void JsonStream::startValue() {
+    if (stack.isEmpty() || stack.last().type != '[' || stack.last().kind == None)
+        return;
+
+    Frame& frame = stack.last();
+    if (!frame.expectValue)
+        return;
+
+    if (frame.kept > 0)
+        envelope.append(',');
+
+    frame.kept++;
+    frame.expectValue = false;
+}
+
+void JsonStream::endRecord() {
+    auto parsed = ArenaJson::parse(element.constBegin(), element.constEnd(), nullptr, false);
+
+    // Keeps the capacity, so the next record is read without allocating
+    element.resize(0);
+
+    if (!parsed.is_object())
+        return;
+
+    if (recordKind == Unspent) {
+        records[replyIndex].unspent.push_back(FastJson::unspentFromJson(parsed));
+    } else {
+        records[replyIndex].transactions.push_back(FastJson::txFromJson(parsed));
+    }
+}
+
+bool JsonStream::finish(const QMap<quint64, int>& positions, QList<BatchReply>& out) {
+    // Anything that doesn't come back is reported as an error for that item
+    BatchReply missing;
+    missing.error = "{\"message\":\"No reply from moonroomcashd\"}";
+    for (int i = 0; i < positions.size(); i++) {
+        out.push_back(missing);
+    }
+
+    auto parsed = ArenaJson::parse(envelope.constBegin(), envelope.constEnd(), nullptr, false);
+    if (parsed.is_discarded() || !parsed.is_array() || recordDepth != 0)
+        return false;
+
+    for (int i = 0; i < (int)parsed.size(); i++) {
+        auto& it = parsed[i];
+        if (!it.is_object() || it.find("id") == it.end() || !it["id"].is_number_unsigned())
+            continue;
+
+        auto id = it["id"].get<ArenaJson::number_unsigned_t>();
+        if (!positions.contains(id))
+            continue;
+
+        BatchReply reply;
+        auto error  = it.find("error");
+        auto result = it.find("result");
+        if (error != it.end() && !error->is_null()) {
+            auto text = error->dump();
+            reply.error = QString::fromUtf8(text.data(), (int)text.size());
+        } else if (result != it.end()) {
+            auto text = result->dump();
+            reply = records.value(i);
+            reply.result = QByteArray(text.data(), (int)text.size());
+        }
+
+        out[positions[id]] = reply;
+    }
+
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#include "fastjson.h"
+
+/**
+ * Decodes a JSON-RPC batch reply while it is still arriving, so the network transfer and the
+ * parsing overlap, and the big lists are never held in memory as text.
+ *
+ * The reply is fed in as pieces of any size. Each record in a "result" list of objects
+ * (listunspent, z_listunspent) or in "result.transactions" (listsinceblock) is parsed on its own as
+ * soon as its closing brace arrives, and turned into an UnspentRecord or TxRecord. Everything else
+ * (the ids, errors and small results) is kept as text with the records cut out, and parsed at the
+ * end. So the text in memory is bounded by the largest record plus that small envelope.
+ */
+class JsonStream {
+public:
+    void    feed(const QByteArray& chunk);
+
+    // Once the whole reply was fed, put the replies in payload order using positions (request id -> index),
+    // the same as FastJson::decodeBatch. Returns false if the reply wasn't a JSON-RPC batch.
+    bool    finish(const QMap<quint64, int>& positions, QList<BatchReply>& out);
+
+private:
+    enum RecordKind {
+        None,
+        Unspent,        // Elements of "result"
+        Transaction     // Elements of "transactions"
+    };
+
+    struct Frame {
+        char        type;               // '{' or '['
+        RecordKind  kind;               // For arrays, what their object elements are
+        QByteArray  key;                // For objects, the key of the current member
+        bool        expectValue;        // For record arrays, if the next char starts an element
+        int         kept;               // For record arrays, the elements left in the envelope
+    };
+
+    void    startValue();
+    void    endRecord();
+
+    QByteArray      envelope;           // The reply, without the records
+    QByteArray      element;            // The record being read
+    QByteArray      lastString;         // The last string read in an object, to know the keys
+
+    QList<Frame>    stack;
+    bool            inString        = false;
+    bool            escaped         = false;
+
+    int             recordDepth     = 0;        // Nesting inside the record being read, 0 if not in one
+    RecordKind      recordKind      = None;
+
+    int             replyIndex      = -1;       // The batch item being read
+    QMap<int, BatchReply> records;              // Batch item -> its decoded records
+};
+
+#endif // JSONSTREAM_H
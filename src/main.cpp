@@ -1,6 +1,8 @@
 #include "mainwindow.h"
 #include "settings.h"
 #include "turnstile.h"
+#include "blocknotifier.h"
+#include "tracer.h"
 
 #include "version.h"
 
@@ -8,6 +10,13 @@
 
 int main(int argc, char *argv[])
 {
+    // moonroomcashd runs us with --blocknotify <server> <blockhash> when it gets a new block. Pass it 
+    // on to the running wallet and exit, without bringing up any UI.
+    if (argc >= 4 && QString::fromStdString(argv[1]) == "--blocknotify") {
+        QCoreApplication a(argc, argv);
+        return BlockNotifier::notifyRunningWallet(QString::fromStdString(argv[2]), QString::fromStdString(argv[3])) ? 0 : 1;
+    }
+
     QCoreApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 
@@ -32,11 +41,17 @@ int main(int argc, char *argv[])
 
     Settings::init();
 
-    if (argc >= 2 && QString::fromStdString(argv[1]) == "--no-embedded") {
-        Settings::getInstance()->setUseEmbedded(false);
-    } else {
-        Settings::getInstance()->setUseEmbedded(true);
+    bool useEmbedded = true;
+    for (int i = 1; i < argc; i++) {
+        auto arg = QString::fromStdString(argv[i]);
+        if (arg == "--no-embedded") {
+            useEmbedded = false;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            // Write a trace of the refreshes that can be opened in chrome://tracing or Perfetto
+            Tracer::getInstance()->start(QString::fromLocal8Bit(argv[++i]));
+        }
     }
+    Settings::getInstance()->setUseEmbedded(useEmbedded);
 
     QCoreApplication::setOrganizationName("mrc-qt-wallet-org");
     QCoreApplication::setApplicationName("mrc-qt-wallet");
@@ -45,5 +60,8 @@ int main(int argc, char *argv[])
     w.setWindowTitle("mrc-qt-wallet v" + QString(APP_VERSION));
     w.show();
     
-    return QApplication::exec();
+    auto ret = QApplication::exec();
+    Tracer::getInstance()->finish();
+
+    return ret;
 }
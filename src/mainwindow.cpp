@@ -5,6 +5,7 @@
 #include "ui_zboard.h"
 #include "ui_privkey.h"
 #include "ui_about.h"
+#include "ui_diagnostics.h"
 #include "ui_settings.h"
 #include "ui_turnstile.h"
 #include "ui_turnstileprogress.h"
@@ -57,6 +58,9 @@ MainWindow::MainWindow(QWidget *parent) :
     // Address Book
     QObject::connect(ui->action_Address_Book, &QAction::triggered, this, &MainWindow::addressBook);
 
+    // RPC Diagnostics
+    QObject::connect(ui->actionDiagnostics, &QAction::triggered, this, &MainWindow::diagnostics);
+
     // Set up about action
     QObject::connect(ui->actionAbout, &QAction::triggered, [=] () {
         QDialog aboutDialog(this);
@@ -579,8 +583,7 @@ void MainWindow::postToZBoard() {
         std::cout << std::setw(2) << params << std::endl;
 
         // And send the Tx
-        rpc->sendZTransaction(params, [=](const json& reply) {
-            QString opid = QString::fromStdString(reply.get<json::string_t>());
+        rpc->sendZTransaction(params, [=](QString opid) {
             ui->statusBar->showMessage(tr("Computing Tx: ") % opid);
 
             // And then start monitoring the transaction
@@ -612,9 +615,9 @@ void MainWindow::doImport(QList<QString>* keys) {
 
     if (key.startsWith("S") ||
         key.startsWith("secret")) { // Z key
-        rpc->importZPrivKey(key, rescan, [=] (auto) { this->doImport(keys); });                   
+        rpc->importZPrivKey(key, rescan, [=] () { this->doImport(keys); });                   
     } else {
-        rpc->importTPrivKey(key, rescan, [=] (auto) { this->doImport(keys); });
+        rpc->importTPrivKey(key, rescan, [=] () { this->doImport(keys); });
     }
 }
 
@@ -682,6 +685,74 @@ void MainWindow::backupWalletDat() {
     }
 }
 
+/**
+ * Show the RPC stats of each method, to see what the refreshes spend their time on. The table
+ * updates every second while the dialog is open.
+ */
+void MainWindow::diagnostics() {
+    if (rpc->getConnection() == nullptr)
+        return;
+
+    QDialog d(this);
+    Ui_Diagnostics diag;
+    diag.setupUi(&d);
+    Settings::saveRestore(&d);
+
+    QStringList headers = { tr("Method"), tr("Calls"), tr("Errors"), tr("Retries"), tr("Shared"), tr("Prefetched"),
+                            tr("Expired"), tr("p50 ms"), tr("p90 ms"), tr("p99 ms"), tr("Bytes sent"), tr("Bytes received") };
+    diag.statsTable->setColumnCount(headers.size());
+    diag.statsTable->setHorizontalHeaderLabels(headers);
+
+    auto fnFill = [=] () {
+        // The connection might have been replaced since the dialog opened
+        auto conn = rpc->getConnection();
+        if (conn == nullptr)
+            return;
+
+        auto& methods = conn->getStats()->methods();
+
+        // Sorting moves the rows around while they are being filled in
+        diag.statsTable->setSortingEnabled(false);
+        diag.statsTable->setRowCount(methods.size());
+
+        int row = 0;
+        for (auto it = methods.constBegin(); it != methods.constEnd(); it++, row++) {
+            auto& s = it.value();
+            QList<qint64> values = { s.calls, s.errors, s.retries, s.shared, s.prefetched, s.prefetchExpired,
+                                     s.latency.percentile(0.5), s.latency.percentile(0.9), s.latency.percentile(0.99),
+                                     s.requestBytes, s.responseBytes };
+
+            diag.statsTable->setItem(row, 0, new QTableWidgetItem(it.key()));
+            for (int col = 0; col < values.size(); col++) {
+                // As a number, so the column sorts by value
+                auto item = new QTableWidgetItem();
+                item->setData(Qt::DisplayRole, values[col]);
+                diag.statsTable->setItem(row, col + 1, item);
+            }
+        }
+
+        diag.statsTable->setSortingEnabled(true);
+    };
+    fnFill();
+
+    QTimer timer;
+    QObject::connect(&timer, &QTimer::timeout, fnFill);
+    timer.start(1000);
+
+    QObject::connect(diag.logButton, &QPushButton::clicked, [=] () {
+        if (rpc->getConnection() != nullptr)
+            logger->write(rpc->getConnection()->getStats()->report());
+    });
+
+    QObject::connect(diag.resetButton, &QPushButton::clicked, [=] () {
+        if (rpc->getConnection() != nullptr)
+            rpc->getConnection()->getStats()->reset();
+        fnFill();
+    });
+
+    d.exec();
+}
+
 void MainWindow::exportAllKeys() {
     exportKeys("");
 }
@@ -726,13 +797,8 @@ void MainWindow::exportKeys(QString addr) {
         out << pui.privKeyTxt->toPlainText();
     });
 
-    // Call the API
-    auto isDialogAlive = std::make_shared<bool>(true);
-
+    // Call the API. The calls are cancelled when the dialog closes, so they don't keep moonroomcashd busy.
     auto fnUpdateUIWithKeys = [=](QList<QPair<QString, QString>> privKeys) {
-        // Check to see if we are still showing.
-        if (! *(isDialogAlive.get()) ) return;
-
         QString allKeysTxt;
         for (auto keypair : privKeys) {
             allKeysTxt = allKeysTxt % keypair.second % " # addr=" % keypair.first % "\n";
@@ -742,26 +808,27 @@ void MainWindow::exportKeys(QString addr) {
         pui.buttonBox->button(QDialogButtonBox::Save)->setEnabled(true);
     };
 
+    RPCHandle handle;
     if (allKeys) {
-        rpc->getAllPrivKeys(fnUpdateUIWithKeys);
+        handle = rpc->getAllPrivKeys(fnUpdateUIWithKeys);
     }
     else {        
-        auto fnAddKey = [=](json key) {
+        auto fnAddKey = [=](QString key) {
             QList<QPair<QString, QString>> singleAddrKey;
-            singleAddrKey.push_back(QPair<QString, QString>(addr, QString::fromStdString(key.get<json::string_t>())));
+            singleAddrKey.push_back(QPair<QString, QString>(addr, key));
             fnUpdateUIWithKeys(singleAddrKey);
         };
 
         if (Settings::getInstance()->isZAddress(addr)) {
-            rpc->getZPrivKey(addr, fnAddKey);
+            handle = rpc->getZPrivKey(addr, fnAddKey);
         }
         else {
-            rpc->getTPrivKey(addr, fnAddKey);
+            handle = rpc->getTPrivKey(addr, fnAddKey);
         }        
     }
+    handle.cancelWith(&d);
     
     d.exec();
-    *isDialogAlive = false;
 }
 
 void MainWindow::setupBalancesTab() {
@@ -921,8 +988,7 @@ void MainWindow::setupTransactionsTab() {
 
 void MainWindow::addNewZaddr() {
 
-    rpc->newZaddr([=] (json reply) {
-        QString addr = QString::fromStdString(reply.get<json::string_t>());
+    rpc->newZaddr([=] (QString addr) {
         // Make sure the RPC class reloads the z-addrs for future use
         rpc->refreshAddresses();
 
@@ -963,8 +1029,7 @@ std::function<void(bool)> MainWindow::addZAddrsToComboList() {
 
 void MainWindow::setupRecieveTab() {
     auto addNewTAddr = [=] () {
-        rpc->newTaddr([=] (json reply) {
-            QString addr = QString::fromStdString(reply.get<json::string_t>());
+        rpc->newTaddr([=] (QString addr) {
 
             // Just double make sure the t-address is still checked
             if (ui->rdioTAddr->isChecked()) {
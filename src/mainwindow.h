@@ -94,6 +94,7 @@ private:
     void exportAllKeys();
     void exportKeys(QString addr = "");
     void backupWalletDat();
+    void diagnostics();
 
     void doImport(QList<QString>* keys);
 
@@ -0,0 +1,149 @@
+#include "metricsserver.h"
+#include "rpcstats.h"
+
+#ifdef Q_OS_DARWIN
+#include <mach/mach.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+// Requests are a single GET, so anything bigger than this isn't a scrape
+static const int maxRequestSize = 8 * 1024;
+
+// Drop connections that don't send a whole request in time
+static const int requestTimeout = 10 * 1000;
+
+// Label values can have \, " and newlines escaped
+static QString escaped(const QString& value) {
+    QString out = value;
+    out.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+    return out;
+}
+
+void MetricsWriter::family(const QString& name, const QString& type, const QString& help) {
+    out.append(("# HELP " % name % " " % help % "\n# TYPE " % name % " " % type % "\n").toUtf8());
+}
+
+void MetricsWriter::sample(const QString& name, double value, const MetricLabels& labels) {
+    write(name, labels, QString::number(value, 'g', 12));
+}
+
+void MetricsWriter::sample(const QString& name, qint64 value, const MetricLabels& labels) {
+    write(name, labels, QString::number(value));
+}
+
+void MetricsWriter::summary(const QString& name, const LatencyHistogram& latency, const MetricLabels& labels) {
+    for (auto q : { 0.5, 0.9, 0.99 }) {
+        auto withQuantile = labels;
+        withQuantile.push_back(qMakePair(QString("quantile"), QString::number(q)));
+        sample(name, latency.percentile(q) / 1000.0, withQuantile);
+    }
+
+    sample(name % "_sum",   latency.sum() / 1000.0, labels);
+    sample(name % "_count", latency.count(), labels);
+}
+
+void MetricsWriter::write(const QString& name, const MetricLabels& labels, const QString& value) {
+    QString line = name;
+    if (!labels.isEmpty()) {
+        QStringList pairs;
+        for (auto& label : labels) {
+            pairs.push_back(label.first % "=\"" % escaped(label.second) % "\"");
+        }
+        line = line % "{" % pairs.join(",") % "}";
+    }
+
+    out.append((line % " " % value % "\n").toUtf8());
+}
+
+MetricsServer::MetricsServer(int port, const std::function<void(MetricsWriter&)>& collect) {
+    this->collect = collect;
+
+    // Only reachable from this machine. Scrapers elsewhere go through an exporter or a tunnel.
+    server = new QTcpServer();
+    if (!server->listen(QHostAddress::LocalHost, (quint16)port)) {
+        qDebug() << "Couldn't serve metrics on port" << port << ":" << server->errorString();
+        return;
+    }
+
+    qDebug() << "Serving metrics at http://127.0.0.1:" + QString::number(port) + "/metrics";
+
+    QObject::connect(server, &QTcpServer::newConnection, [=] () {
+        while (server->hasPendingConnections()) {
+            auto socket = server->nextPendingConnection();
+
+            QTimer::singleShot(requestTimeout, socket, [=] () { socket->abort(); });
+            QObject::connect(socket, &QTcpSocket::readyRead, [=] () { serve(socket); });
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        }
+    });
+}
+
+MetricsServer::~MetricsServer() {
+    delete server;
+}
+
+// Answer once the request line and headers are in. The body, if any, is ignored.
+void MetricsServer::serve(QTcpSocket* socket) {
+    auto request = socket->property("request").toByteArray() + socket->readAll();
+    if (request.size() > maxRequestSize) {
+        socket->abort();
+        return;
+    }
+
+    if (!request.contains("\r\n\r\n")) {
+        socket->setProperty("request", request);
+        return;
+    }
+
+    auto parts  = request.left(request.indexOf("\r\n")).split(' ');
+    auto method = parts.value(0);
+    auto path   = parts.value(1);
+    if (path.contains('?'))
+        path = path.left(path.indexOf('?'));
+
+    if (method != "GET") {
+        respond(socket, "405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+    } else if (path != "/metrics") {
+        respond(socket, "404 Not Found", "text/plain", "Metrics are at /metrics\n");
+    } else {
+        MetricsWriter out;
+        collect(out);
+        respond(socket, "200 OK", "text/plain; version=0.0.4; charset=utf-8", out.text());
+    }
+}
+
+void MetricsServer::respond(QTcpSocket* socket, const QByteArray& status, const QByteArray& contentType,
+                            const QByteArray& body) {
+    QByteArray reply = "HTTP/1.1 " + status + "\r\n"
+                       "Content-Type: " + contentType + "\r\n"
+                       "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+
+    socket->write(reply);
+    socket->disconnectFromHost();
+}
+
+qint64 MetricsServer::residentBytes() {
+#ifdef Q_OS_LINUX
+    // The second field of statm is the resident set, in pages
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+
+    auto fields = statm.readAll().split(' ');
+    if (fields.size() < 2)
+        return -1;
+
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#elif defined(Q_OS_DARWIN)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return -1;
+
+    return (qint64)info.resident_size;
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,53 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include "precompiled.h"
+
+class LatencyHistogram;
+
+typedef QList<QPair<QString, QString>> MetricLabels;
+
+/**
+ * Builds a page in the Prometheus text format. Each metric is started with family(), and followed
+ * by its samples.
+ */
+class MetricsWriter {
+public:
+    void    family (const QString& name, const QString& type, const QString& help);
+    void    sample (const QString& name, double value, const MetricLabels& labels = MetricLabels());
+    void    sample (const QString& name, qint64 value, const MetricLabels& labels = MetricLabels());
+
+    // The percentiles, sum and count of a summary, in seconds
+    void    summary(const QString& name, const LatencyHistogram& latency, const MetricLabels& labels = MetricLabels());
+
+    const QByteArray& text() const { return out; }
+
+private:
+    void    write(const QString& name, const MetricLabels& labels, const QString& value);
+
+    QByteArray out;
+};
+
+/**
+ * Serves the wallet's metrics at http://127.0.0.1:<port>/metrics, for Prometheus to scrape. Off
+ * unless a port is set (see Settings::getMetricsPort).
+ *
+ * The metrics are collected when they are asked for, by the collect function, on the UI thread.
+ */
+class MetricsServer {
+public:
+    MetricsServer(int port, const std::function<void(MetricsWriter&)>& collect);
+    ~MetricsServer();
+
+    static qint64   residentBytes();        // The process's RSS, -1 where it isn't known
+
+private:
+    void    serve(QTcpSocket* socket);
+    void    respond(QTcpSocket* socket, const QByteArray& status, const QByteArray& contentType, const QByteArray& body);
+
+    QTcpServer*     server          = nullptr;
+
+    std::function<void(MetricsWriter&)> collect;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,63 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+/**
+ * Lock free queue with any number of producers and a single consumer (an intrusive linked list,
+ * after Dmitry Vyukov's MPSC queue). push() can be called from any thread, pop() only from the
+ * thread that owns the queue.
+ *
+ * pop() can miss an item whose push() hasn't finished yet, so producers should wake the
+ * consumer only after push() returns.
+ */
+template<class T>
+class MPSCQueue {
+public:
+    MPSCQueue() {
+        tail = new Node();
+        head.store(tail, std::memory_order_relaxed);
+    }
+
+    ~MPSCQueue() {
+        T item;
+        while (pop(item)) {}
+        delete tail;
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    void push(T item) {
+        Node* node = new Node();
+        node->item = std::move(item);
+
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T& item) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return false;
+
+        item = std::move(next->item);
+        next->item = T();
+
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*>  next { nullptr };
+        T                   item;
+    };
+
+    std::atomic<Node*>  head;       // Producers push here
+    Node*               tail;       // The consumer pops from here. Always points to a (consumed) dummy node.
+};
+
+#endif // MPSCQUEUE_H
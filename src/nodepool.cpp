@@ -0,0 +1,161 @@
+#include "nodepool.h"
+#include "circuitbreaker.h"
+
+// How often each node is sent a health check
+static const int healthInterval = 10 * 1000;
+
+// A node this many blocks behind the highest one is out of date, and left out of the reads
+static const int maxLag         = 2;
+
+NodePool::NodePool(const QNetworkRequest& primary, const QList<QNetworkRequest>& replicas,
+                   const std::function<void(int node)>& check) {
+    this->check = check;
+
+    // The primary is in until it is known to be down. The replicas are only in once they answered.
+    Node first;
+    first.request = primary;
+    first.healthy = true;
+    nodes.push_back(first);
+
+    for (auto& replica : replicas) {
+        Node node;
+        node.request = replica;
+        nodes.push_back(node);
+    }
+
+    if (nodes.size() == 1)
+        return;
+
+    // Check on all of them right away, and then every few seconds
+    timer = new QTimer();
+    QObject::connect(timer, &QTimer::timeout, [=] () {
+        timer->setInterval(healthInterval);
+        for (int i = 0; i < nodes.size(); i++) {
+            this->check(i);
+        }
+    });
+    timer->start(0);
+}
+
+NodePool::~NodePool() {
+    delete timer;
+}
+
+/**
+ * The node that should answer first: the one with the least requests in flight, weighed by how long
+ * it took to reply lately. Nodes that haven't replied yet have no latency, so they are tried first.
+ */
+int NodePool::pick(bool replicable) {
+    if (!replicable || nodes.size() == 1)
+        return primary;
+
+    int    best      = -1;
+    double bestScore = 0;
+    for (int i = 0; i < nodes.size(); i++) {
+        if (!nodes[i].healthy || !isCurrent(i))
+            continue;
+
+        double score = (nodes[i].latency + 1) * (nodes[i].inFlight + 1);
+        if (best < 0 || score < bestScore) {
+            best      = i;
+            bestScore = score;
+        }
+    }
+
+    if (best < 0)
+        return primary;
+
+    return best;
+}
+
+/**
+ * The wallet just changed on the primary, for eg. it spent some notes or made a new address, and the
+ * replicas won't see it before it is mined. So the reads go to the primary until the replicas are
+ * past the highest block seen so far.
+ */
+void NodePool::pinPrimary() {
+    pinnedUntil = std::max(pinnedUntil, highestHeight() + 1);
+}
+
+/**
+ * A replica is current if it has the primary's tip and is past the last pin. The primary always is.
+ * While the primary is out, its last height could be old, so the replicas are held to the highest
+ * height any node answered instead.
+ */
+bool NodePool::isCurrent(int node) const {
+    if (node == primary)
+        return true;
+
+    int tip = nodes[primary].healthy ? nodes[primary].height : highestHeight();
+    return tip >= 0 && nodes[node].height >= tip && nodes[node].height >= pinnedUntil;
+}
+
+// The highest block any node answered, including the ones that are out now
+int NodePool::highestHeight() const {
+    int highest = -1;
+    for (auto& n : nodes) {
+        if (n.height > highest)
+            highest = n.height;
+    }
+
+    return highest;
+}
+
+void NodePool::started(int node) {
+    nodes[node].inFlight++;
+}
+
+void NodePool::finished(int node, const RPCError& error, qint64 ms) {
+    Node& n = nodes[node];
+    n.inFlight--;
+
+    if (error.code == QNetworkReply::OperationCanceledError)
+        return;
+
+    if (CircuitBreaker::isUnreachable(error.code)) {
+        // Leave it out until it answers a health check again
+        if (nodes.size() > 1) {
+            n.down = true;
+            setHealthy(node, false);
+        }
+        return;
+    }
+
+    n.latency = n.latency == 0 ? ms : 0.8 * n.latency + 0.2 * ms;
+}
+
+void NodePool::checked(int node, int height) {
+    // The last height it answered is kept, so the replicas can still be compared against it
+    nodes[node].down = height < 0;
+    if (height < 0) {
+        setHealthy(node, false);
+        return;
+    }
+
+    nodes[node].height = height;
+    int highest = highestHeight();
+
+    // The node that answered might be ahead of the others, so they are all looked at again
+    for (int i = 0; i < nodes.size(); i++) {
+        if (nodes[i].down || nodes[i].height < 0)
+            continue;
+
+        setHealthy(i, nodes[i].height >= highest - maxLag);
+    }
+}
+
+void NodePool::setHealthy(int node, bool healthy) {
+    if (nodes[node].healthy == healthy)
+        return;
+
+    nodes[node].healthy = healthy;
+    if (healthy)
+        qDebug() << "Sending reads to" << nameOf(node) << "again";
+    else
+        qDebug() << "Not sending reads to" << nameOf(node) << ", it is down or behind";
+}
+
+QString NodePool::nameOf(int node) const {
+    auto url = nodes[node].request.url();
+    return url.host() % ":" % QString::number(url.port());
+}
@@ -0,0 +1,69 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include "precompiled.h"
+#include "rpcworker.h"
+
+/**
+ * The moonroomcashd nodes a Connection sends to: the primary, which holds the wallet's keys, and the
+ * replicas set up in the settings (see Settings::getRPCReplicas).
+ *
+ * The calls that only read the wallet (see RPCMethods::isReplicable) go to whichever healthy node
+ * should answer first, going by how fast each one replied lately and how many requests it already
+ * has in flight, so one overloaded node doesn't hold up the refreshes. Everything else, like sending
+ * and the keys, always goes to the primary.
+ *
+ * A node is taken out as soon as a request can't reach it. Every few seconds each node is sent a
+ * getblockcount, and it is put back once it answers, as long as it isn't more than a couple of blocks
+ * behind the others. If no node is healthy, the reads go to the primary too.
+ *
+ * A replica only gets reads once it is at the primary's height, or at the highest height any node
+ * answered while the primary is out. It doesn't see the primary's mempool or the wallet changes that
+ * aren't mined yet, so after a spend or a new address (see pinPrimary()) the reads stay on the primary
+ * until the replicas are past the next block.
+ *
+ * The replicas have to hold the same wallet (for eg. with its keys imported) to answer the wallet calls.
+ *
+ * Only used on the UI thread.
+ */
+class NodePool {
+public:
+    // check is run with each node's index, to send it a health check. See checked().
+    NodePool(const QNetworkRequest& primary, const QList<QNetworkRequest>& replicas,
+             const std::function<void(int node)>& check);
+    ~NodePool();
+
+    static const int primary = 0;
+
+    int     size() const { return nodes.size(); }
+    const QNetworkRequest& request(int node) const { return nodes[node].request; }
+
+    int     pick(bool replicable);                          // The node to send a request to
+    void    pinPrimary();                                   // Read from the primary until the next block
+    void    started(int node);
+    void    finished(int node, const RPCError& error, qint64 ms);
+    void    checked(int node, int height);                  // The block count the node answered, -1 if it didn't
+
+private:
+    struct Node {
+        QNetworkRequest request;
+        bool    healthy     = false;
+        bool    down        = false;    // Didn't answer the last request or health check
+        int     inFlight    = 0;
+        int     height      = -1;       // At the last health check it answered
+        double  latency     = 0;        // Moving average, in ms
+    };
+
+    void    setHealthy(int node, bool healthy);
+    bool    isCurrent(int node) const;
+    int     highestHeight() const;
+    QString nameOf(int node) const;
+
+    QList<Node>                     nodes;
+    std::function<void(int node)>   check;
+    QTimer*                         timer   = nullptr;
+
+    int     pinnedUntil = 0;        // The height a replica needs before it gets reads again
+};
+
+#endif // NODEPOOL_H
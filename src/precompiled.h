@@ -32,6 +32,8 @@
 #include <QCompleter>
 #include <QDateTime>
 #include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
 #include <QSettings>
 #include <QStyle>
 #include <QFile>
@@ -52,6 +54,10 @@
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
@@ -0,0 +1,75 @@
+#include "prefetcher.h"
+
+// Prefetched replies are only good for the refresh they were fetched for
+static const int maxAge     = 10 * 1000;
+
+// Don't hold on to more than this, for eg. while the refreshes are paused
+static const int maxEntries = 10 * 1000;
+
+Prefetcher::Prefetcher(const std::function<void(const QList<json>&)>& send,
+                       const std::function<void(const QString& method)>& expired) {
+    this->send    = send;
+    this->expired = expired;
+}
+
+void Prefetcher::addRule(const QString& method, const Rule& rule) {
+    rules[method] = rule;
+}
+
+void Prefetcher::observe(const QString& method, const json& result) {
+    auto rule = rules.find(method);
+    if (rule == rules.end())
+        return;
+
+    prune();
+
+    auto next = rule.value()(result);
+    if (!next.isEmpty())
+        send(next);
+}
+
+bool Prefetcher::has(const QString& key) {
+    auto it = cache.find(key);
+    return it != cache.end() && it->age.elapsed() < maxAge;
+}
+
+void Prefetcher::put(const QString& key, const QString& method, const json& result) {
+    if (cache.size() >= maxEntries)
+        return;
+
+    Entry entry;
+    entry.method = method;
+    entry.result = result;
+    entry.age.start();
+    cache[key] = entry;
+}
+
+bool Prefetcher::take(const QString& key, json& result) {
+    auto it = cache.find(key);
+    if (it == cache.end())
+        return false;
+
+    bool fresh = it->age.elapsed() < maxAge;
+    if (fresh)
+        result = std::move(it->result);
+    else
+        expired(it->method);
+
+    cache.erase(it);
+    return fresh;
+}
+
+void Prefetcher::clear() {
+    cache.clear();
+}
+
+void Prefetcher::prune() {
+    for (auto it = cache.begin(); it != cache.end(); ) {
+        if (it->age.elapsed() >= maxAge) {
+            expired(it->method);
+            it = cache.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
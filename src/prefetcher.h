@@ -0,0 +1,56 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "precompiled.h"
+
+using json = nlohmann::json;
+
+/**
+ * Hides the round trips of the calls that depend on an earlier reply, which add up over a slow link
+ * to a remote node. For eg. the gettransaction of a received note can only be sent once the
+ * z_listreceivedbyaddress that lists it is back.
+ *
+ * A rule says which calls are going to follow a reply to some method. As soon as such a reply comes
+ * in, even if it is only one part of a bigger batch, the calls are sent speculatively, and their
+ * replies kept for a few seconds. When the refresh gets to them, Connection::doBatchRPC takes the
+ * replies from here (or shares the request if it is still in flight) instead of sending them again.
+ *
+ * Replies that expire before the refresh asks for them are passed to expired, for RPCStats.
+ *
+ * Only read only calls should be prefetched. Only used on the UI thread.
+ */
+class Prefetcher {
+public:
+    // The calls that will follow this reply
+    typedef std::function<QList<json>(const json& result)> Rule;
+
+    Prefetcher(const std::function<void(const QList<json>&)>& send,
+               const std::function<void(const QString& method)>& expired);
+
+    void    addRule(const QString& method, const Rule& rule);
+    bool    follows(const QString& method) const { return rules.contains(method); }
+
+    void    observe(const QString& method, const json& result);    // A reply to method came in
+
+    bool    has (const QString& key);
+    void    put (const QString& key, const QString& method, const json& result);
+    bool    take(const QString& key, json& result);                 // A prefetched reply is only used once
+    void    clear();
+
+private:
+    struct Entry {
+        QString         method;
+        json            result;
+        QElapsedTimer   age;
+    };
+
+    void    prune();
+
+    std::function<void(const QList<json>&)> send;
+    std::function<void(const QString&)>     expired;
+
+    QMap<QString, Rule>     rules;
+    QMap<QString, Entry>    cache;      // Keyed like the in-flight requests, see Connection::requestKey
+};
+
+#endif // PREFETCHER_H
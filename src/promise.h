@@ -0,0 +1,170 @@
+#ifndef PROMISE_H
+#define PROMISE_H
+
+#include "precompiled.h"
+#include "rpcworker.h"
+
+template<class T> class Future;
+template<class T> class Promise;
+
+namespace FutureDetail {
+    template<class T>
+    struct State {
+        bool        settled = false;
+        bool        failed  = false;
+        std::shared_ptr<T>  value;
+        RPCError    error   { QNetworkReply::NoError, QString(), json() };
+
+        QList<std::function<void(void)>> waiting;
+
+        void whenSettled(const std::function<void(void)>& fn) {
+            if (settled)
+                fn();
+            else
+                waiting.push_back(fn);
+        }
+
+        void settle() {
+            settled = true;
+
+            auto callbacks = waiting;
+            waiting.clear();
+            for (auto& fn : callbacks) {
+                fn();
+            }
+        }
+    };
+
+    // What then(f) returns: the Future that f returns, or a Future of whatever else f returns
+    template<class R> struct Chained            { typedef Future<R> Type; };
+    template<class R> struct Chained<Future<R>> { typedef Future<R> Type; };
+
+    template<class U> void forward(const Promise<U>& next, const Future<U>& result);
+    template<class U> void forward(const Promise<U>& next, U result);
+}
+
+/**
+ * The result of an RPC call that hasn't arrived yet, or its RPCError.
+ *
+ * Futures are composed with then(), and joined with whenAll(), instead of nesting
+ * callbacks and counting replies by hand. The callbacks run on the thread that settles the future,
+ * which is the UI thread for the futures Connection returns. If a future is already settled, a
+ * callback added to it runs right away.
+ */
+template<class T>
+class Future {
+public:
+    typedef T ValueType;
+
+    bool isReady() const { return state->settled; }
+
+    // Run cb with the value, or ne with the error, once this settles
+    void done(const std::function<void(const T&)>& cb,
+              const std::function<void(const RPCError&)>& ne = nullptr) const {
+        auto s = state;
+        s->whenSettled([=] () {
+            if (!s->failed)
+                cb(*s->value);
+            else if (ne)
+                ne(s->error);
+        });
+    }
+
+    // Run f with the value, and return a future of what f returns. f can return another future,
+    // which is chained in. An error skips f and goes straight to the returned future.
+    template<class F>
+    auto then(F f) const -> typename FutureDetail::Chained<decltype(f(std::declval<const T&>()))>::Type {
+        typedef typename FutureDetail::Chained<decltype(f(std::declval<const T&>()))>::Type Next;
+
+        Promise<typename Next::ValueType> next;
+        done([=] (const T& value) {
+            FutureDetail::forward(next, f(value));
+        }, [=] (const RPCError& error) {
+            next.reject(error);
+        });
+        return next.future();
+    }
+
+    static Future<T> resolved(T value) {
+        Promise<T> promise;
+        promise.resolve(std::move(value));
+        return promise.future();
+    }
+
+private:
+    friend class Promise<T>;
+    explicit Future(const std::shared_ptr<FutureDetail::State<T>>& s) : state(s) {}
+
+    std::shared_ptr<FutureDetail::State<T>> state;
+};
+
+// The producing side of a Future. Only the first resolve() or reject() counts.
+template<class T>
+class Promise {
+public:
+    Promise() : state(std::make_shared<FutureDetail::State<T>>()) {}
+
+    Future<T> future() const { return Future<T>(state); }
+
+    void resolve(T value) const {
+        if (state->settled)
+            return;
+
+        state->value = std::make_shared<T>(std::move(value));
+        state->settle();
+    }
+
+    void reject(const RPCError& error) const {
+        if (state->settled)
+            return;
+
+        state->failed = true;
+        state->error  = error;
+        state->settle();
+    }
+
+private:
+    std::shared_ptr<FutureDetail::State<T>> state;
+};
+
+namespace FutureDetail {
+    template<class U>
+    void forward(const Promise<U>& next, const Future<U>& result) {
+        result.done([=] (const U& value) {
+            next.resolve(value);
+        }, [=] (const RPCError& error) {
+            next.reject(error);
+        });
+    }
+
+    template<class U>
+    void forward(const Promise<U>& next, U result) {
+        next.resolve(std::move(result));
+    }
+}
+
+// All the values, in the same order as the futures, or the first error. An empty list resolves right away.
+template<class T>
+Future<QList<T>> whenAll(const QList<Future<T>>& futures) {
+    Promise<QList<T>> all;
+    if (futures.isEmpty()) {
+        all.resolve(QList<T>());
+        return all.future();
+    }
+
+    int  total   = futures.size();
+    auto results = std::make_shared<QMap<int, T>>();
+    for (int i = 0; i < total; i++) {
+        futures[i].done([=] (const T& value) {
+            results->insert(i, value);
+            if (results->size() == total)
+                all.resolve(results->values());
+        }, [=] (const RPCError& error) {
+            all.reject(error);
+        });
+    }
+
+    return all.future();
+}
+
+#endif // PROMISE_H
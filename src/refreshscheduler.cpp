@@ -0,0 +1,192 @@
+#include "refreshscheduler.h"
+
+bool ActivityFilter::eventFilter(QObject* obj, QEvent* event) {
+    switch (event->type()) {
+    case QEvent::KeyPress:
+    case QEvent::MouseButtonPress:
+    case QEvent::Wheel:
+    case QEvent::WindowActivate:
+        scheduler->activity();
+        break;
+    default:
+        break;
+    }
+
+    return QObject::eventFilter(obj, event);
+}
+
+RefreshScheduler::RefreshScheduler(QWidget* _window, const std::function<bool(void)>& _isBusy) {
+    this->window = _window;
+    this->isBusy = _isBusy;
+
+    clock.start();
+
+    timer = new QTimer();
+    timer->setSingleShot(true);
+    QObject::connect(timer, &QTimer::timeout, [=] () {
+        fire();
+    });
+
+    filter = new ActivityFilter(this);
+    qApp->installEventFilter(filter);
+}
+
+RefreshScheduler::~RefreshScheduler() {
+    qApp->removeEventFilter(filter);
+
+    delete filter;
+    delete timer;
+}
+
+/**
+ * Run fn every interval ms. The first run is one interval from now.
+ */
+void RefreshScheduler::addTask(const QString& name, int interval, bool backoff, const std::function<void(void)>& fn) {
+    qint64 now = clock.elapsed();
+    tasks[name] = ScheduledTask{ interval, backoff, fn, now, now + interval, 0 };
+
+    reschedule();
+}
+
+void RefreshScheduler::removeTask(const QString& name) {
+    tasks.remove(name);
+
+    reschedule();
+}
+
+void RefreshScheduler::setInterval(const QString& name, int interval) {
+    if (!tasks.contains(name))
+        return;
+
+    auto& task = tasks[name];
+    if (task.interval == interval)
+        return;
+
+    task.interval = interval;
+    task.due      = std::min(task.due, task.lastRun + effectiveInterval(task));
+
+    reschedule();
+}
+
+/**
+ * Run the task now instead of waiting for its next turn, for eg. because there is a new block. While
+ * the tasks are backed off, it still doesn't run more often than its backed off interval, and it
+ * never runs more often than its cost allows.
+ */
+void RefreshScheduler::runSoon(const QString& name) {
+    if (!tasks.contains(name))
+        return;
+
+    auto& task = tasks[name];
+
+    qint64 gap = backoffLevel > 0 && !isBusy() ? effectiveInterval(task) : task.cost * costFactor;
+    task.due   = std::min(task.due, std::max(task.lastRun + gap, clock.elapsed()));
+
+    reschedule();
+}
+
+// Remember how long the task took, smoothed over the last few runs
+void RefreshScheduler::recordCost(const QString& name, qint64 ms) {
+    if (!tasks.contains(name))
+        return;
+
+    auto& task = tasks[name];
+    task.cost = (task.cost * 3 + ms) / 4;
+}
+
+/**
+ * The user did something. If the tasks were backed off, bring them back to their normal
+ * interval, running the ones that are overdue right away.
+ */
+void RefreshScheduler::activity() {
+    lastActivity = clock.elapsed();
+
+    if (backoffLevel == 0)
+        return;
+
+    backoffLevel = 0;
+    for (auto& task : tasks) {
+        task.due = std::min(task.due, task.lastRun + effectiveInterval(task));
+    }
+
+    reschedule();
+}
+
+bool RefreshScheduler::isIdle() {
+    if (window->isHidden() || window->isMinimized())
+        return true;
+
+    return clock.elapsed() - lastActivity > idleAfter;
+}
+
+qint64 RefreshScheduler::effectiveInterval(const ScheduledTask& task) {
+    qint64 interval = task.interval;
+
+    if (task.backoff && backoffLevel > 0 && !isBusy()) {
+        interval = interval << backoffLevel;
+    }
+
+    if (interval < task.cost * costFactor) {
+        interval = task.cost * costFactor;
+    }
+
+    return interval;
+}
+
+void RefreshScheduler::fire() {
+    qint64 now = clock.elapsed();
+
+    // Collect the due tasks first, since running a task can change the tasks
+    QList<QString> due;
+    for (auto it = tasks.constBegin(); it != tasks.constEnd(); ++it) {
+        if (it->due <= now)
+            due.push_back(it.key());
+    }
+
+    bool ranBackoffTask = false;
+    for (auto name : due) {
+        if (!tasks.contains(name))
+            continue;
+
+        // A copy, since the task can remove itself while it runs, for eg. BlockNotifier::stop()
+        auto fn = tasks[name].fn;
+        fn();
+
+        if (!tasks.contains(name))
+            continue;
+
+        auto& task   = tasks[name];
+        task.lastRun = now;
+        task.due     = now + effectiveInterval(task);
+
+        ranBackoffTask = ranBackoffTask || task.backoff;
+    }
+
+    // Every round that runs while the user is away backs off a bit more
+    if (ranBackoffTask) {
+        if (isIdle() && !isBusy()) {
+            if (backoffLevel < maxBackoff)
+                backoffLevel++;
+        } else {
+            backoffLevel = 0;
+        }
+    }
+
+    reschedule();
+}
+
+void RefreshScheduler::reschedule() {
+    if (tasks.isEmpty()) {
+        timer->stop();
+        return;
+    }
+
+    qint64 next = -1;
+    for (auto& task : tasks) {
+        if (next < 0 || task.due < next)
+            next = task.due;
+    }
+
+    qint64 wait = next - clock.elapsed();
+    timer->start(wait > 0 ? (int)wait : 0);
+}
@@ -0,0 +1,75 @@
+#ifndef REFRESHSCHEDULER_H
+#define REFRESHSCHEDULER_H
+
+#include "precompiled.h"
+
+class RefreshScheduler;
+
+// Watches the app's input events, so the scheduler knows when the user is around
+class ActivityFilter : public QObject {
+public:
+    ActivityFilter(RefreshScheduler* _scheduler) : scheduler(_scheduler) {}
+
+protected:
+    bool eventFilter(QObject* obj, QEvent* event) override;
+
+private:
+    RefreshScheduler* scheduler;
+};
+
+struct ScheduledTask {
+    int                         interval;       // How often to run when the user is around, in ms
+    bool                        backoff;        // Slow down when the wallet is idle
+    std::function<void(void)>   fn;
+
+    qint64                      lastRun;
+    qint64                      due;
+    qint64                      cost;           // Measured time the task takes, in ms
+};
+
+/**
+ * Runs all the periodic refreshes off a single timer. How often each one runs depends on:
+ * - Whether the user is around. When the window is hidden or minimized, or there was no input for
+ *   a while, tasks back off exponentially, up to 32x their interval. Any input resets them.
+ * - Pending operations. While the wallet is busy (for eg. computing a tx), nothing backs off.
+ * - How long the task takes. A task is never run more often than every 10x its measured cost,
+ *   so a slow node isn't kept busy all the time.
+ */
+class RefreshScheduler {
+public:
+    RefreshScheduler(QWidget* _window, const std::function<bool(void)>& _isBusy);
+    ~RefreshScheduler();
+
+    void    addTask(const QString& name, int interval, bool backoff, const std::function<void(void)>& fn);
+    void    removeTask(const QString& name);
+    void    setInterval(const QString& name, int interval);
+    void    runSoon(const QString& name);
+    void    recordCost(const QString& name, qint64 ms);
+
+    void    activity();
+
+private:
+    void    fire();
+    void    reschedule();
+
+    bool    isIdle();
+    qint64  effectiveInterval(const ScheduledTask& task);
+
+    QWidget*                        window;
+    std::function<bool(void)>       isBusy;
+
+    QTimer*                         timer;
+    ActivityFilter*                 filter;
+    QElapsedTimer                   clock;
+
+    QMap<QString, ScheduledTask>    tasks;
+
+    qint64  lastActivity    = 0;
+    int     backoffLevel    = 0;
+
+    static const int idleAfter      = 5 * 60 * 1000;    // No input for 5 mins means the user is away
+    static const int maxBackoff     = 5;                // 2^5 = 32x the interval
+    static const int costFactor     = 10;
+};
+
+#endif // REFRESHSCHEDULER_H
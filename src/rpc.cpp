@@ -4,9 +4,29 @@
 #include "settings.h"
 #include "senttxstore.h"
 #include "turnstile.h"
+#include "txcache.h"
+#include "txsync.h"
+#include "zrecvsync.h"
+#include "utxoset.h"
+#include "blocknotifier.h"
+#include "tracer.h"
+#include "metricsserver.h"
+#include "arena.h"
+#include "refreshscheduler.h"
 
 using json = nlohmann::json;
 
+// Unconfirmed txs checked with gettransaction on every tick, to see if a new block touched the wallet
+static const int maxCheckedUnconfirmed = 20;
+
+// The block a tx was mined in, worked out from its confirmations at the current block
+static int heightFromConfirmations(qint64 confirmations) {
+    if (confirmations <= 0)
+        return 0;
+
+    return Settings::getInstance()->getBlockNumber() - (int)confirmations + 1;
+}
+
 RPC::RPC(MainWindow* main) {
     auto cl = new ConnectionLoader(main, this);
 
@@ -17,6 +37,18 @@ RPC::RPC(MainWindow* main) {
     this->ui = main->ui;
 
     this->turnstile = new Turnstile(this, main);
+    this->txCache   = new TxCache();
+    this->txSync    = new TxSync(this);
+    this->zRecvSync = new ZRecvSync(this);
+    this->utxoSet   = new UTXOSet(this);
+
+    // Opt in, for monitoring a number of wallets from one place
+    int metricsPort = Settings::getInstance()->getMetricsPort();
+    if (metricsPort > 0) {
+        this->metricsServer = new MetricsServer(metricsPort, [=] (MetricsWriter& out) {
+            writeMetrics(out);
+        });
+    }
 
     // Setup balances table model
     balancesTableModel = new BalancesTableModel(main->ui->balancesTable);
@@ -27,36 +59,47 @@ RPC::RPC(MainWindow* main) {
     main->ui->transactionsTable->setModel(transactionsTableModel);
     main->ui->transactionsTable->horizontalHeader()->setSectionResizeMode(3, QHeaderView::Stretch);
 
-    // Set up timer to refresh Price
-    priceTimer = new QTimer(main);
-    QObject::connect(priceTimer, &QTimer::timeout, [=]() {
+    // All the periodic refreshes run off one scheduler, which slows them down while the wallet 
+    // is idle. Nothing slows down while there are txs being computed.
+    scheduler = new RefreshScheduler(main, [=] () {
+        return !watchingOps.isEmpty();
+    });
+
+    // Refresh the price every hour
+    scheduler->addTask("price", Settings::priceRefreshSpeed, true, [=] () {
         refreshMRCPrice();
     });
-    priceTimer->start(Settings::priceRefreshSpeed);  // Every hour
 
-    // Set up a timer to refresh the UI every few seconds
-    timer = new QTimer(main);
-    QObject::connect(timer, &QTimer::timeout, [=]() {
+    // Refresh the UI every few seconds
+    scheduler->addTask("refresh", Settings::updateSpeed, true, [=] () {
         refresh();
     });
-    timer->start(Settings::updateSpeed);    
 
-    // Set up the timer to watch for tx status
-    txTimer = new QTimer(main);
-    QObject::connect(txTimer, &QTimer::timeout, [=]() {
+    // Watch for tx status. When an operation is pending, this will run every few seconds
+    scheduler->addTask("txwatch", Settings::updateSpeed, true, [=] () {
         watchTxStatus();
     });
-    // Start at every 10s. When an operation is pending, this will change to every second
-    txTimer->start(Settings::updateSpeed);  
+
+    // Refresh as soon as there's a new block. The scheduled refresh above is only the fallback,
+    // and while the wallet is idle, the new blocks back off along with it.
+    this->blockNotifier = new BlockNotifier(this, main, scheduler, [=] () {
+        scheduler->runSoon("refresh");
+    });
 }
 
 RPC::~RPC() {
-    delete timer;
-    delete txTimer;
+    // The block notifier takes its polls off the scheduler
+    delete blockNotifier;
+    delete scheduler;
 
     delete transactionsTableModel;
     delete balancesTableModel;
     delete turnstile;
+    delete txCache;
+    delete txSync;
+    delete zRecvSync;
+    delete utxoSet;
+    delete metricsServer;
 
     delete utxos;
     delete allBalances;
@@ -79,6 +122,25 @@ void RPC::setConnection(Connection* c) {
     delete conn;
     this->conn = c;
 
+    // Catch up as soon as moonroomcashd answers again after it went away
+    conn->setOnRecovered([=] () {
+        refresh(true);
+    });
+
+    // Look up new notes and new addresses as soon as they show up, see Prefetcher
+    conn->prefetchAfter(RPCMethods::ZListReceivedByAddress::name(), [=] (const json& notes) {
+        return prefetchNoteTxs(notes);
+    });
+    conn->prefetchAfter(RPCMethods::ZListAddresses::name(), [=] (const json& addrs) {
+        return prefetchReceived(addrs);
+    });
+
+    // This might be a different node, so sync the tx history from scratch
+    txSync->reset();
+    zRecvSync->reset();
+    utxoSet->reset();
+    blockNotifier->start();
+
     ui->statusBar->showMessage("Ready!");
 
     refreshMRCPrice();
@@ -88,221 +150,234 @@ void RPC::setConnection(Connection* c) {
     refresh(true);
 }
 
-void RPC::getZAddresses(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_listaddresses"},
-    };
-
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+void RPC::getZAddresses(const std::function<void(QList<QString>)>& cb) {
+    conn->callWithDefaultErrorHandling<RPCMethods::ZListAddresses>({}, cb);
 }
 
-void RPC::getTransparentUnspent(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "listunspent"},
-        {"params", {0}}             // Get UTXOs with 0 confirmations as well.
-    };
+// A new address is only in the primary's wallet, so the address lists are read from there for a while
+void RPC::newZaddr(const std::function<void(QString)>& cb) {
+    conn->callWithDefaultErrorHandling<RPCMethods::ZGetNewAddress>({}, [=] (QString addr) {
+        conn->pinReadsToPrimary();
+        cb(addr);
+    });
+}
 
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+void RPC::newTaddr(const std::function<void(QString)>& cb) {
+    conn->callWithDefaultErrorHandling<RPCMethods::GetNewAddress>({}, [=] (QString addr) {
+        conn->pinReadsToPrimary();
+        cb(addr);
+    });
 }
 
-void RPC::getZUnspent(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_listunspent"},
-        {"params", {0}}             // Get UTXOs with 0 confirmations as well.
-    };
+RPCHandle RPC::getZPrivKey(QString addr, const std::function<void(QString)>& cb) {
+    return conn->callWithDefaultErrorHandling<RPCMethods::ZExportKey>({ addr }, cb);
+}
 
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+RPCHandle RPC::getTPrivKey(QString addr, const std::function<void(QString)>& cb) {
+    return conn->callWithDefaultErrorHandling<RPCMethods::DumpPrivKey>({ addr }, cb);
 }
 
-void RPC::newZaddr(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_getnewaddress"},
-    };
-    
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+void RPC::importZPrivKey(QString addr, bool rescan, const std::function<void(void)>& cb) {
+    conn->callWithDefaultErrorHandling<RPCMethods::ZImportKey>({ addr, rescan }, [=] (RPCMethods::None) { cb(); });
 }
 
-void RPC::newTaddr(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "getnewaddress"},
-    };
 
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+void RPC::importTPrivKey(QString addr, bool rescan, const std::function<void(void)>& cb) {
+    conn->callWithDefaultErrorHandling<RPCMethods::ImportPrivKey>({ addr, rescan }, [=] (RPCMethods::None) { cb(); });
 }
 
-void RPC::getZPrivKey(QString addr, const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_exportkey"},
-        {"params", { addr.toStdString() }},
-    };
-    
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
-}
 
-void RPC::getTPrivKey(QString addr, const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "dumpprivkey"},
-        {"params", { addr.toStdString() }},
-    };
-    
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
-}
+/**
+ * The gettransaction calls getTxDetails is going to make for the notes in a z_listreceivedbyaddress
+ * reply: the txs that aren't mined yet, or were never seen. Change is left out, like ZRecvSync does.
+ */
+QList<json> RPC::prefetchNoteTxs(const json& notes) {
+    QList<json> next;
+    RPCMethods::ZListReceivedByAddress::Result received;
+    if (!Settings::getInstance()->getSaveZtxs() || !RPCMethods::ZListReceivedByAddress::decode(notes, received))
+        return next;
+
+    QSet<QString> seen;
+    for (auto& note : received) {
+        if (note.change || seen.contains(note.txid) || txCache->isMined(note.txid))
+            continue;
+
+        seen.insert(note.txid);
+        next.push_back(RPCMethods::payload<RPCMethods::GetTransaction>({ note.txid }));
+    }
 
-void RPC::importZPrivKey(QString addr, bool rescan, const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_importkey"},
-        {"params", { addr.toStdString(), (rescan? "yes" : "no") }},
-    };
-    
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+    return next;
 }
 
+// The z_listreceivedbyaddress calls ZRecvSync is going to make for the addresses it hasn't scanned yet
+QList<json> RPC::prefetchReceived(const json& addrs) {
+    QList<json> next;
+    if (!addrs.is_array() || !Settings::getInstance()->getSaveZtxs())
+        return next;
 
-void RPC::importTPrivKey(QString addr, bool rescan, const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "importprivkey"},
-        {"params", { addr.toStdString(), (rescan? "yes" : "no") }},
-    };
-    
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+    for (auto& addr : addrs) {
+        if (!addr.is_string())
+            continue;
+
+        auto zaddr = QString::fromStdString(addr.get<json::string_t>());
+        if (!zRecvSync->isScanned(zaddr))
+            next.push_back(RPCMethods::payload<RPCMethods::ZListReceivedByAddress>({ zaddr, 0 }));
+    }
+
+    return next;
 }
 
+/**
+ * Get the gettransaction details for all the txids. Txs that are already mined come from the tx cache, 
+ * with the confirmations calculated from the block they were mined in. Only unmined txs (and txs
+ * whose block was reorged out) are fetched from moonroomcashd. If any of the calls fails, ne gets
+ * the error instead.
+ */
+void RPC::getTxDetails(const QList<QString>& txids, const std::function<void(QMap<QString, json>*)>& cb,
+                       const std::function<void(const RPCError&)>& ne) {
+    int curBlock = Settings::getInstance()->getBlockNumber();
+
+    // Fetch the txs that are not in the cache, and cache them
+    auto fnFetch = [=] (QList<QString> toFetch) {
+        return conn->doBatchRPCAsync<QString>(toFetch, [=] (QString txid) {
+            return RPCMethods::payload<RPCMethods::GetTransaction>({ txid });
+        }).then([=] (const QMap<QString, json>& fetched) {
+            for (auto it = fetched.constBegin(); it != fetched.constEnd(); it++) {
+                txCache->put(it.key(), it.value(), curBlock);
+            }
+            if (!fetched.isEmpty())
+                txCache->save();
 
-void RPC::getBalance(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_gettotalbalance"},
-        {"params", {0}}             // Get Unconfirmed balance as well.
+            return fetched;
+        });
     };
 
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
-}
+    if (verifiedAtBlock != curBlock) {
+        verifiedBlockHashes.clear();
+        verifiedAtBlock = curBlock;
+    }
 
-void RPC::getTransactions(const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "listtransactions"}
-    };
+    QMap<QString, json> cached;
+    QList<QString>  toFetch;
+    QList<QString>  toVerify;       // Mined txs that are shallow enough to be reorged
+    QSet<int>       heights;        // ...and the blocks they were mined in
+    for (auto txid : txids) {
+        if (!txCache->isMined(txid)) {
+            toFetch.push_back(txid);
+        } else if (txCache->isFinal(txid, curBlock) || 
+                   (verifiedBlockHashes.contains(txCache->height(txid)) && 
+                    verifiedBlockHashes.value(txCache->height(txid)) == txCache->blockhash(txid))) {
+            cached[txid] = txCache->get(txid, curBlock);
+        } else {
+            toVerify.push_back(txid);
+            heights.insert(txCache->height(txid));
+        }
+    }
 
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
-}
+    // Cheap reorg check: If the block at the tx's height still has the same hash, the tx is 
+    // still where we saw it. Otherwise, forget it and fetch it again. This runs at the same
+    // time as the fetch of the unmined txs.
+    auto verified = conn->doBatchRPCAsync<int>(heights.toList(), [=] (int height) {
+        return RPCMethods::payload<RPCMethods::GetBlockHash>({ height });
+    }).then([=] (const QMap<int, json>& hashes) {
+        QMap<QString, json> stillMined;
+        QList<QString>      reorged;
+        for (auto txid : toVerify) {
+            int  height = txCache->height(txid);
+            auto hash   = hashes.value(height);
+
+            if (hash.is_string() && QString::fromStdString(hash.get<json::string_t>()) == txCache->blockhash(txid)) {
+                verifiedBlockHashes[height] = txCache->blockhash(txid);
+                stillMined[txid] = txCache->get(txid, curBlock);
+            } else {
+                txCache->remove(txid);
+                reorged.push_back(txid);
+            }
+        }
 
-void RPC::sendZTransaction(json params, const std::function<void(json)>& cb) {
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_sendmany"},
-        {"params", params}
-    };
+        return fnFetch(reorged).then([=] (const QMap<QString, json>& fetched) {
+            auto all = stillMined;
+            for (auto it = fetched.constBegin(); it != fetched.constEnd(); it++) {
+                all[it.key()] = it.value();
+            }
+            return all;
+        });
+    });
 
-    conn->doRPCWithDefaultErrorHandling(payload, cb);
+    QList<Future<QMap<QString, json>>> parts;
+    parts.push_back(Future<QMap<QString, json>>::resolved(cached));
+    parts.push_back(fnFetch(toFetch));
+    parts.push_back(verified);
+
+    whenAll(parts).done([=] (const QList<QMap<QString, json>>& parts) {
+        auto details = new QMap<QString, json>();
+        for (auto& part : parts) {
+            for (auto it = part.constBegin(); it != part.constEnd(); it++) {
+                (*details)[it.key()] = it.value();
+            }
+        }
+
+        cb(details);
+    }, ne);
+}
+
+void RPC::sendZTransaction(json params, const std::function<void(QString)>& cb) {
+    conn->callWithDefaultErrorHandling<RPCMethods::ZSendMany>({ params }, cb);
 }
 
 /**
- * Method to get all the private keys for both z and t addresses. It will make 2 batch calls,
- * combine the result, and call the callback with a single list containing both the t-addr and z-addr
+ * Method to get all the private keys for both z and t addresses. The t and z keys are fetched
+ * at the same time, and the callback gets a single list containing both the t-addr and z-addr
  * private keys
  */ 
-void RPC::getAllPrivKeys(const std::function<void(QList<QPair<QString, QString>>)> cb) {
+RPCHandle RPC::getAllPrivKeys(const std::function<void(QList<QPair<QString, QString>>)> cb) {
+    RPCHandle handle;
     if (conn == nullptr) {
         // No connection, just return
-        return;
+        return handle;
     }
 
-    // A special function that will call the callback when two lists have been added
-    auto holder = new QPair<int, QList<QPair<QString, QString>>>();
-    holder->first = 0;  // This is the number of times the callback has been called, initialized to 0
-    auto fnCombineTwoLists = [=] (QList<QPair<QString, QString>> list) {
-        // Increment the callback counter
-        holder->first++;    
-
-        // Add all
-        std::copy(list.begin(), list.end(), std::back_inserter(holder->second));
-        
-        // And if the caller has been called twice, do the parent callback with the 
-        // collected list
-        if (holder->first == 2) {
-            // Sort so z addresses are on top
-            std::sort(holder->second.begin(), holder->second.end(), 
-                        [=] (auto a, auto b) { return a.first > b.first; });
-
-            cb(holder->second);
-            delete holder;
-        }            
-    };
-
-    // A utility fn to do the batch calling
-    auto fnDoBatchGetPrivKeys = [=](json getAddressPayload, std::string privKeyDumpMethodName) {
-        conn->doRPCWithDefaultErrorHandling(getAddressPayload, [=] (json resp) {
-            QList<QString> addrs;
-            for (auto addr : resp.get<json::array_t>()) {   
-                addrs.push_back(QString::fromStdString(addr.get<json::string_t>()));
+    typedef QList<QPair<QString, QString>> KeyList;
+
+    // Get the private keys of all the addresses in a single batch
+    auto fnGetPrivKeys = [=] (Future<QList<QString>> addrs, bool z) {
+        return addrs.then([=] (const QList<QString>& addrs) {
+            return conn->doBatchRPCAsync<QString>(addrs, [=] (QString addr) {
+                return z ? RPCMethods::payload<RPCMethods::ZExportKey>({ addr }) : 
+                           RPCMethods::payload<RPCMethods::DumpPrivKey>({ addr });
+            }, handle);
+        }).then([=] (const QMap<QString, json>& privkeys) {
+            KeyList keys;
+            for (auto it = privkeys.constBegin(); it != privkeys.constEnd(); it++) {
+                QString key;
+                if (RPCMethods::decodeString(it.value(), key))
+                    keys.push_back(QPair<QString, QString>(it.key(), key));
             }
-
-            // Then, do a batch request to get all the private keys
-            conn->doBatchRPC<QString>(
-                addrs, 
-                [=] (auto addr) {
-                    json payload = {
-                        {"jsonrpc", "1.0"},
-                        {"id", "someid"},
-                        {"method", privKeyDumpMethodName},
-                        {"params", { addr.toStdString() }},
-                    };
-                    return payload;
-                },
-                [=] (QMap<QString, json>* privkeys) {
-                    QList<QPair<QString, QString>> allTKeys;
-                    for (QString addr: privkeys->keys()) {
-                        allTKeys.push_back(
-                            QPair<QString, QString>(
-                                addr, 
-                                QString::fromStdString(privkeys->value(addr).get<json::string_t>())));
-                    }
-
-                    fnCombineTwoLists(allTKeys);
-                    delete privkeys;
-                }
-            );
+            return keys;
         });
     };
 
-    // First get all the t and z addresses.
-    json payloadT = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "getaddressesbyaccount"},
-        {"params", {""} }
-    };
+    QList<Future<KeyList>> lists;
+    lists.push_back(fnGetPrivKeys(conn->callAsync<RPCMethods::GetAddressesByAccount>({ "" }, handle), false));
+    lists.push_back(fnGetPrivKeys(conn->callAsync<RPCMethods::ZListAddresses>({}, handle), true));
 
-    json payloadZ = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_listaddresses"}
-    };
+    whenAll(lists).done([=] (const QList<KeyList>& lists) {
+        KeyList allKeys;
+        for (auto& list : lists) {
+            allKeys.append(list);
+        }
+
+        // Sort so z addresses are on top
+        std::sort(allKeys.begin(), allKeys.end(), 
+                    [=] (auto a, auto b) { return a.first > b.first; });
+
+        cb(allKeys);
+    }, [=] (const RPCError& error) {
+        conn->showTxError(error.errorMessage());
+    });
 
-    fnDoBatchGetPrivKeys(payloadT, "dumpprivkey");
-    fnDoBatchGetPrivKeys(payloadZ, "z_exportkey");
+    // Cancelling this also cancels all the calls above
+    return handle;
 }
 
 
@@ -383,102 +458,11 @@ void RPC::refreshReceivedZTrans(QList<QString> zaddrs) {
         transactionsTableModel->addZRecvData(emptylist);
         return;
     }
-        
-    // This method is complicated because z_listreceivedbyaddress only returns the txid, and 
-    // we have to make a follow up call to gettransaction to get details of that transaction. 
-    // Additionally, it has to be done in batches, because there are multiple z-Addresses, 
-    // and each z-Addr can have multiple received txs. 
-
-    // 1. For each z-Addr, get list of received txs    
-    conn->doBatchRPC<QString>(zaddrs,
-        [=] (QString zaddr) {
-            json payload = {
-                {"jsonrpc", "1.0"},
-                {"id", "z_lrba"},
-                {"method", "z_listreceivedbyaddress"},
-                {"params", {zaddr.toStdString(), 0}}      // Accept 0 conf as well.
-            };
-
-            return payload;
-        },          
-        [=] (QMap<QString, json>* zaddrTxids) {
-            // Process all txids, removing duplicates. This can happen if the same address
-            // appears multiple times in a single tx's outputs.
-            QSet<QString> txids;
-            QMap<QString, QString> memos;
-            for (auto it = zaddrTxids->constBegin(); it != zaddrTxids->constEnd(); it++) {
-                auto zaddr = it.key();
-                for (auto& i : it.value().get<json::array_t>()) {   
-                    // Filter out change txs
-                    if (! i["change"].get<json::boolean_t>()) {
-                        auto txid = QString::fromStdString(i["txid"].get<json::string_t>());
-                        txids.insert(txid);    
-
-                        // Check for Memos
-                        QString memoBytes = QString::fromStdString(i["memo"].get<json::string_t>());
-                        if (!memoBytes.startsWith("f600"))  {
-                            QString memo(QByteArray::fromHex(
-                                            QByteArray::fromStdString(i["memo"].get<json::string_t>())));
-                            if (!memo.trimmed().isEmpty())
-                                memos[zaddr + txid] = memo;
-                        }
-                    }
-                }        
-            }
-
-            // 2. For all txids, go and get the details of that txid.
-            conn->doBatchRPC<QString>(txids.toList(),
-                [=] (QString txid) {
-                    json payload = {
-                        {"jsonrpc", "1.0"},
-                        {"id",  "gettx"},
-                        {"method", "gettransaction"},
-                        {"params", {txid.toStdString()}}
-                    };
-
-                    return payload;
-                },
-                [=] (QMap<QString, json>* txidDetails) {
-                    QList<TransactionItem> txdata;
-
-                    // Combine them both together. For every zAddr's txid, get the amount, fee, confirmations and time
-                    for (auto it = zaddrTxids->constBegin(); it != zaddrTxids->constEnd(); it++) {                        
-                        for (auto& i : it.value().get<json::array_t>()) {   
-                            // Filter out change txs
-                            if (i["change"].get<json::boolean_t>())
-                                continue;
-                            
-                            auto zaddr = it.key();
-                            auto txid  = QString::fromStdString(i["txid"].get<json::string_t>());
-
-                            // Lookup txid in the map
-                            auto txidInfo = txidDetails->value(txid);
-
-                            qint64 timestamp;
-                            if (txidInfo.find("time") != txidInfo.end()) {
-                                timestamp = txidInfo["time"].get<json::number_unsigned_t>();
-                            } else {
-                                timestamp = txidInfo["blocktime"].get<json::number_unsigned_t>();
-                            }
-                            
-                            auto amount        = i["amount"].get<json::number_float_t>();
-                            auto confirmations = (unsigned long)txidInfo["confirmations"].get<json::number_unsigned_t>();                            
-
-                            TransactionItem tx{ QString("receive"), timestamp, zaddr, txid, amount, 
-                                                confirmations, "", memos.value(zaddr + txid, "") };
-                            txdata.push_front(tx);
-                        }
-                    }
-
-                    transactionsTableModel->addZRecvData(txdata);
 
-                    // Cleanup both responses;
-                    delete zaddrTxids;
-                    delete txidDetails;
-                }
-            );
-        }
-    );
+    // Only this tick's shard of addresses is scanned, and only the new or not yet deep notes are processed
+    zRecvSync->sync(zaddrs, [=] (QList<TransactionItem> txdata) {
+        updateTransactions("received z txs", [&] () { transactionsTableModel->addZRecvData(txdata); });
+    });
 } 
 
 /// This will refresh all the balance data from moonroomcashd
@@ -494,74 +478,95 @@ void RPC::getInfoThenRefresh(bool force) {
     if  (conn == nullptr) 
         return noConnection();
 
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "getinfo"}
-    };
+    // moonroomcashd isn't answering, so don't fan out the refreshes. The connection checks on it
+    // with a heartbeat instead, and refreshes when it is back.
+    if (!conn->isResponding())
+        return;
+
+    // Everything traced from here on is tagged with this refresh, until the next one starts
+    if (Tracer::isEnabled())
+        Tracer::getInstance()->setCycle(Tracer::getInstance()->newId());
+
+    // The per-tick status calls all go out as a single batch
+    QList<json> payloads;
+    payloads.push_back(RPCMethods::payload<RPCMethods::GetInfo>());
+
+    // Call to see if the blockchain is syncing. 
+    payloads.push_back(RPCMethods::payload<RPCMethods::GetBlockchainInfo>());
+
+    // Cheap summary of the wallet, to see if anything changed since the last refresh
+    payloads.push_back(RPCMethods::payload<RPCMethods::GetWalletInfo>());
+
+    // Get network sol/s
+    int solpsAt = -1;
+    if (emoonroomcashd) {
+        solpsAt = payloads.size();
+        payloads.push_back(RPCMethods::payload<RPCMethods::GetNetworkSolps>());
+    }
+
+    // Our unconfirmed txs, to see if any of them got mined or dropped. Only a few are checked, the
+    // balances in getwalletinfo change with the rest.
+    QStringList unconfirmed = transactionsTableModel->getUnconfirmedTxids().toList();
+    unconfirmed.sort();
+    unconfirmed = unconfirmed.mid(0, maxCheckedUnconfirmed);
+
+    int txsAt = payloads.size();
+    for (auto& txid : unconfirmed) {
+        payloads.push_back(RPCMethods::payload<RPCMethods::GetTransaction>({ txid }));
+    }
 
     static bool prevCallSucceeded = false;
-    conn->doRPC(payload, [=] (const json& reply) {   
-        prevCallSucceeded = true;
-        // Testnet?
-        if (!reply["testnet"].is_null()) {
-            Settings::getInstance()->setTestnet(reply["testnet"].get<json::boolean_t>());
-        };
 
-        // Connected, so display checkmark.
-        QIcon i(":/icons/res/connected.gif");
-        main->statusIcon->setPixmap(i.pixmap(16, 16));
+    auto fnConnectionError = [=] (const QString& error) {
+        // moonroomcashd has probably disappeared.
+        this->noConnection();
 
-        static int    lastBlock = 0;
-        int curBlock  = reply["blocks"].get<json::number_integer_t>();
+        // Prevent multiple dialog boxes, because these are called async
+        static bool shown = false;
+        if (!shown && prevCallSucceeded) { // show error only first time
+            shown = true;
+            QMessageBox::critical(main, "Connection Error", "There was an error connecting to moonroomcashd. The error was: \n\n"
+                + error, QMessageBox::StandardButton::Ok);
+            shown = false;
+        }
 
-        if ( force || (curBlock != lastBlock) ) {
-            // Something changed, so refresh everything.
-            lastBlock = curBlock;
+        prevCallSucceeded = false;
+    };
 
-            refreshBalances();        
-            refreshAddresses(); // This calls refreshZSentTransactions() and refreshReceivedZTrans()
-            refreshTransactions();
+    conn->doRPCArray(payloads, [=] (QList<json> replies) {
+        RPCMethods::GetInfo::Result info;
+        if (!RPCMethods::result<RPCMethods::GetInfo>(replies[0], info)) {
+            RPCError error { QNetworkReply::NoError, "Unexpected reply to getinfo", replies[0] };
+            return fnConnectionError(error.errorMessage());
         }
 
-        // Get network sol/s
-        if (emoonroomcashd) {
-            int conns = reply["connections"].get<json::number_integer_t>();
-
-            json payload = {
-                {"jsonrpc", "1.0"},
-                {"id", "someid"},
-                {"method", "getnetworksolps"}
-            };
-
-            conn->doRPCIgnoreError(payload, [=](const json& reply) {
-                qint64 solrate = reply.get<json::number_unsigned_t>();
-
-                ui->numconnections->setText(QString::number(conns));
-                ui->solrate->setText(QString::number(solrate) % " Sol/s");
-            });
-        } 
-
-        // Call to see if the blockchain is syncing. 
-        json payload = {
-            {"jsonrpc", "1.0"},
-            {"id", "someid"},
-            {"method", "getblockchaininfo"}
-        };
+        prevCallSucceeded = true;
 
-        conn->doRPCIgnoreError(payload, [=](const json& reply) {
-            auto progress    = reply["verificationprogress"].get<double>();
+        // Process the blockchain info first, so the block number is current before
+        // anything else gets refreshed.
+        RPCMethods::GetBlockchainInfo::Result chainInfo;
+        if (RPCMethods::result<RPCMethods::GetBlockchainInfo>(replies[1], chainInfo)) {
+            auto progress    = chainInfo.verificationProgress;
             bool isSyncing   = progress < 0.9999; // 99.99%
-            int  blockNumber = reply["blocks"].get<json::number_unsigned_t>();
+            int  blockNumber = chainInfo.blocks;
 
-            int estimatedheight = 0;
-            if (reply.find("estimatedheight") != reply.end()) {
-                estimatedheight = reply["estimatedheight"].get<json::number_unsigned_t>();
-            }
+            int estimatedheight = chainInfo.estimatedHeight;
 
             Settings::getInstance()->setSyncing(isSyncing);
             Settings::getInstance()->setBlockNumber(blockNumber);
 
+            // Confirmations are worked out from the block each tx was mined in, so they are 
+            // current on every tick without asking moonroomcashd about each tx again.
+            transactionsTableModel->updateConfirmations(blockNumber);
+
+            // The same for the unspent outputs, which are otherwise only filled in by refreshBalances
+            if (utxos != nullptr) {
+                for (auto& utxo : *utxos) {
+                    if (utxo.height > 0)
+                        utxo.confirmations = std::max(blockNumber - utxo.height + 1, 1);
+                }
+            }
+
             // Update moonroomcashd tab if it exists
             if (emoonroomcashd) {
                 if (isSyncing) {
@@ -587,33 +592,169 @@ void RPC::getInfoThenRefresh(bool force) {
                 (isSyncing ? ("/" % QString::number(progress*100, 'f', 0) % "%") : QString()) %
                 ")";
             main->statusLabel->setText(statusText);   
+        }
 
-            auto mrcPrice = Settings::getUSDFormat(1);
-            QString tooltip = "Connected to moonroomcashd";;
-            if (!mrcPrice.isEmpty()) {
-                tooltip = "1 MRC = " % mrcPrice % "\n" % tooltip;
-            }
-            main->statusLabel->setToolTip(tooltip);
-            main->statusIcon->setToolTip(tooltip);
-        });
+        // Testnet?
+        if (info.hasTestnet) {
+            Settings::getInstance()->setTestnet(info.testnet);
+        };
 
-    }, [=](QNetworkReply* reply, const json&) {
-        // moonroomcashd has probably disappeared.
-        this->noConnection();
+        // Connected, so display checkmark.
+        QIcon i(":/icons/res/connected.gif");
+        main->statusIcon->setPixmap(i.pixmap(16, 16));
 
-        // Prevent multiple dialog boxes, because these are called async
-        static bool shown = false;
-        if (!shown && prevCallSucceeded) { // show error only first time
-            shown = true;
-            QMessageBox::critical(main, "Connection Error", "There was an error connecting to moonroomcashd. The error was: \n\n"
-                + reply->errorString(), QMessageBox::StandardButton::Ok);
-            shown = false;
+        // Network sol/s, only shown for the embedded moonroomcashd
+        RPCMethods::GetNetworkSolps::Result solrate;
+        if (solpsAt >= 0 && RPCMethods::result<RPCMethods::GetNetworkSolps>(replies[solpsAt], solrate)) {
+            ui->numconnections->setText(QString::number(info.connections));
+            ui->solrate->setText(QString::number(solrate) % " Sol/s");
         }
 
-        prevCallSucceeded = false;
+        static int    lastBlock = 0;
+        int curBlock  = info.blocks;
+        bool newBlock = curBlock != lastBlock;
+        lastBlock = curBlock;
+
+        // A new block only matters if it touched the wallet. Pending ops and the turnstile 
+        // migration are still followed every block, since they act on the block height.
+        auto fingerprint = walletFingerprint(replies[2], unconfirmed, replies.mid(txsAt));
+        bool mustRefresh = force || (newBlock && (!watchingOps.isEmpty() || turnstile->isMigrationPresent()));
+
+        if (mustRefresh || fingerprint.isEmpty() || fingerprint != lastFingerprint) {
+            // Something changed, so refresh everything.
+            lastFingerprint = fingerprint;
+            refreshesRun++;
+
+            refreshBalances();        
+            refreshAddresses(); // This calls refreshZSentTransactions() and refreshReceivedZTrans()
+            refreshTransactions();
+        } else if (newBlock) {
+            refreshesSkipped++;
+        }
+
+        auto mrcPrice = Settings::getUSDFormat(1);
+        QString tooltip = "Connected to moonroomcashd";
+        if (!mrcPrice.isEmpty()) {
+            tooltip = "1 MRC = " % mrcPrice % "\n" % tooltip;
+        }
+        tooltip = tooltip % "\nRefreshes: " % QString::number(refreshesRun) % " run, " % 
+                  QString::number(refreshesSkipped) % " skipped (wallet unchanged)";
+        main->statusLabel->setToolTip(tooltip);
+        main->statusIcon->setToolTip(tooltip);
+    }, [=](const RPCError& error) {
+        fnConnectionError(error.message);
     });
 }
 
+/**
+ * Summarize the wallet from the getwalletinfo reply and the gettransaction replies for our unconfirmed
+ * txids: the number of txs, the balances, and which of those txs are still unconfirmed. If this doesn't
+ * change, the new block didn't touch the wallet. Returns an empty string if it couldn't be worked out.
+ */
+QString RPC::walletFingerprint(const json& walletInfo, const QStringList& txids, const QList<json>& txs) {
+    RPCMethods::GetWalletInfo::Result info;
+    if (!RPCMethods::result<RPCMethods::GetWalletInfo>(walletInfo, info))
+        return QString();
+
+    QString fingerprint;
+    for (auto value : { info.txCount, info.balance, info.unconfirmedBalance, info.immatureBalance, 
+                        info.shieldedBalance, info.shieldedUnconfirmedBalance }) {
+        fingerprint = fingerprint % QString::number(value) % "|";
+    }
+
+    // When one of our unconfirmed txs gets mined it has confirmations, and when it is dropped they go
+    // negative (or the wallet forgets it)
+    for (int i = 0; i < txids.size() && i < txs.size(); i++) {
+        RPCMethods::GetTransaction::Result    tx;
+        RPCMethods::GetTransaction::Details   details;
+        QString state = "?";
+        if (RPCMethods::result<RPCMethods::GetTransaction>(txs[i], tx) && RPCMethods::GetTransaction::details(tx, details))
+            state = details.confirmations > 0 ? "mined" : (details.confirmations < 0 ? "dropped" : "pending");
+
+        fingerprint = fingerprint % txids[i] % ":" % state % ",";
+    }
+
+    return fingerprint;
+}
+
+/**
+ * What the metrics endpoint serves, see MetricsServer. The RPC stats are the ones the diagnostics
+ * dialog shows, and the rest is read from what the refreshes keep in memory.
+ */
+void RPC::writeMetrics(MetricsWriter& out) {
+    out.family("mrc_wallet_up", "gauge", "1 if moonroomcashd is answering");
+    out.sample("mrc_wallet_up", (qint64)(conn != nullptr && conn->isResponding()));
+
+    out.family("mrc_wallet_block_height", "gauge", "Block height at the last refresh");
+    out.sample("mrc_wallet_block_height", (qint64)Settings::getInstance()->getBlockNumber());
+
+    if (conn != nullptr)
+        conn->getStats()->writeMetrics(out);
+
+    out.family("mrc_wallet_refreshes_total", "counter", "Refreshes run, and skipped because the wallet was unchanged");
+    out.sample("mrc_wallet_refreshes_total", (qint64)refreshesRun,     MetricLabels{ qMakePair(QString("result"), QString("run")) });
+    out.sample("mrc_wallet_refreshes_total", (qint64)refreshesSkipped, MetricLabels{ qMakePair(QString("result"), QString("skipped")) });
+
+    out.family("mrc_wallet_refresh_duration_seconds", "summary", "Time to bring the unspent outputs and balances up to date");
+    out.summary("mrc_wallet_refresh_duration_seconds", refreshTimes);
+
+    out.family("mrc_wallet_allocations_total", "counter", "Allocations made decoding replies, in the arena and on the heap");
+    out.sample("mrc_wallet_allocations_total", refreshAllocs.arenaAllocs, MetricLabels{ qMakePair(QString("where"), QString("arena")) });
+    out.sample("mrc_wallet_allocations_total", refreshAllocs.heapAllocs,  MetricLabels{ qMakePair(QString("where"), QString("heap")) });
+    out.family("mrc_wallet_arena_bytes_total", "counter", "Bytes allocated in the arena decoding replies");
+    out.sample("mrc_wallet_arena_bytes_total", refreshAllocs.arenaBytes);
+
+    // Only counted in builds with CONFIG+=countallocs
+    if (refreshAllocs.processAllocs >= 0) {
+        out.family("mrc_wallet_process_allocations_total", "counter", "Allocations made anywhere in the process");
+        out.sample("mrc_wallet_process_allocations_total", refreshAllocs.processAllocs);
+    }
+
+    out.family("mrc_wallet_utxos", "gauge", "Unspent outputs held in memory");
+    out.sample("mrc_wallet_utxos", (qint64)(utxos == nullptr ? 0 : utxos->size()));
+
+    // Only the t-addresses with a balance are kept
+    qint64 taddrs = 0;
+    if (allBalances != nullptr) {
+        for (auto& addr : allBalances->keys()) {
+            if (!Settings::isZAddress(addr))
+                taddrs++;
+        }
+    }
+
+    out.family("mrc_wallet_addresses", "gauge", "z-addresses in the wallet, and t-addresses with a balance");
+    out.sample("mrc_wallet_addresses", (qint64)(zaddresses == nullptr ? 0 : zaddresses->size()), MetricLabels{ qMakePair(QString("type"), QString("z")) });
+    out.sample("mrc_wallet_addresses", taddrs, MetricLabels{ qMakePair(QString("type"), QString("t")) });
+
+    out.family("mrc_wallet_txs", "gauge", "Txs held in memory, in the transactions table and in the tx cache");
+    out.sample("mrc_wallet_txs", (qint64)transactionsTableModel->rowCount(QModelIndex()), MetricLabels{ qMakePair(QString("source"), QString("table")) });
+    out.sample("mrc_wallet_txs", (qint64)txCache->size(),                                 MetricLabels{ qMakePair(QString("source"), QString("cache")) });
+
+    out.family("mrc_wallet_pending_operations", "gauge", "Sent txs still being computed by moonroomcashd");
+    out.sample("mrc_wallet_pending_operations", (qint64)watchingOps.size());
+
+    qint64 stepsDone = 0, stepsTotal = 0, planErrors = 0;
+    if (turnstile->isMigrationPresent()) {
+        auto progress = turnstile->getPlanProgress();
+        stepsDone  = progress.step;
+        stepsTotal = progress.totalSteps;
+        planErrors = progress.hasErrors;
+    }
+
+    out.family("mrc_wallet_turnstile_steps_done", "gauge", "Steps of the turnstile migration plan done");
+    out.sample("mrc_wallet_turnstile_steps_done", stepsDone);
+    out.family("mrc_wallet_turnstile_steps_total", "gauge", "Steps in the turnstile migration plan, 0 if there is none");
+    out.sample("mrc_wallet_turnstile_steps_total", stepsTotal);
+    out.family("mrc_wallet_turnstile_errors", "gauge", "1 if a step of the turnstile migration plan failed");
+    out.sample("mrc_wallet_turnstile_errors", planErrors);
+
+    auto rss = MetricsServer::residentBytes();
+    if (rss >= 0) {
+        out.family("mrc_wallet_resident_memory_bytes", "gauge", "Resident set size of the wallet process");
+        out.sample("mrc_wallet_resident_memory_bytes", rss);
+    }
+}
+
 void RPC::refreshAddresses() {
     if  (conn == nullptr) 
         return noConnection();
@@ -621,11 +762,8 @@ void RPC::refreshAddresses() {
     delete zaddresses;
     zaddresses = new QList<QString>();
 
-    getZAddresses([=] (json reply) {
-        for (auto& it : reply.get<json::array_t>()) {   
-            auto addr = QString::fromStdString(it.get<json::string_t>());
-            zaddresses->push_back(addr);
-        }
+    getZAddresses([=] (QList<QString> addrs) {
+        *zaddresses = addrs;
 
         // Refresh the sent and received txs from all these z-addresses
         refreshSentZTrans();
@@ -641,7 +779,11 @@ void RPC::updateUI(bool anyUnconfirmed) {
     ui->unconfirmedWarning->setVisible(anyUnconfirmed);
 
     // Update balances model data, which will update the table too
-    balancesTableModel->setNewData(allBalances, utxos);
+    {
+        Tracer::Span span("model", "balances model");
+        balancesTableModel->setNewData(allBalances, utxos);
+    }
+    Tracer::getInstance()->repaint(ui->balancesTable->viewport(), "balances table");
 
     // Add all the addresses into the inputs combo box
     auto lastFromAddr = ui->inputsCombo->currentText();
@@ -660,35 +802,23 @@ void RPC::updateUI(bool anyUnconfirmed) {
     }
 };
 
-// Function to process reply of the listunspent and z_listunspent API calls, used below.
-bool RPC::processUnspent(const json& reply) {
-    bool anyUnconfirmed = false;
-    for (auto& it : reply.get<json::array_t>()) {
-        QString qsAddr = QString::fromStdString(it["address"]);
-        auto confirmations = it["confirmations"].get<json::number_unsigned_t>();
-        if (confirmations == 0) {
-            anyUnconfirmed = true;
-        }
-
-        utxos->push_back(
-            UnspentOutput{ qsAddr, QString::fromStdString(it["txid"]),
-                            Settings::getDecimalString(it["amount"].get<json::number_float_t>()),
-                            (int)confirmations, it["spendable"].get<json::boolean_t>() });
-
-        (*allBalances)[qsAddr] = (*allBalances)[qsAddr] + it["amount"].get<json::number_float_t>();
-    }
-    return anyUnconfirmed;
-};
-
 void RPC::refreshBalances() {    
     if  (conn == nullptr) 
         return noConnection();
 
-    // 1. Get the Balances
-    getBalance([=] (json reply) {    
-        auto balT = QString::fromStdString(reply["transparent"]).toDouble();
-        auto balZ = QString::fromStdString(reply["private"]).toDouble();
-        auto tot  = QString::fromStdString(reply["total"]).toDouble();
+    // Time the refresh, so the scheduler doesn't run it more often than the node can keep up with
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // Bring the unspent outputs up to date. The balances come in the same batch, and are what 
+    // the outputs were checked against.
+    utxoSet->update([=] (RPCMethods::ZGetTotalBalance::Result balance) {
+        scheduler->recordCost("refresh", elapsed.elapsed());
+        refreshTimes.add(elapsed.elapsed());
+
+        auto balT = (double)balance.transparent / 100000000;
+        auto balZ = (double)balance.shielded    / 100000000;
+        auto tot  = (double)balance.total       / 100000000;
 
         ui->balSheilded   ->setText(Settings::getMRCDisplayFormat(balZ));
         ui->balTransparent->setText(Settings::getMRCDisplayFormat(balT));
@@ -697,54 +827,49 @@ void RPC::refreshBalances() {
         ui->balSheilded   ->setToolTip(Settings::getUSDFormat(balZ));
         ui->balTransparent->setToolTip(Settings::getUSDFormat(balT));
         ui->balTotal      ->setToolTip(Settings::getUSDFormat(tot));
-    });
 
-    // 2. Get the UTXOs
-    // First, create a new UTXO list, deleting the old one;
-    delete utxos;
-    utxos = new QList<UnspentOutput>();
-    delete allBalances;
-    allBalances = new QMap<QString, double>();
+        // Rebuild the UTXO list and the per-address balances from the set
+        delete utxos;
+        utxos = new QList<UnspentOutput>();
+        delete allBalances;
+        allBalances = new QMap<QString, double>();
 
-    // Call the Transparent and Z unspent APIs serially and then, once they're done, update the UI
-    getTransparentUnspent([=] (json reply) {
-        auto anyTUnconfirmed = processUnspent(reply);
+        utxoSet->fill(utxos, allBalances);
 
-        getZUnspent([=] (json reply) {
-            auto anyZUnconfirmed = processUnspent(reply);
+        // A z-address with a new note needs its received txs scanned on the next refresh
+        for (auto& utxo : *utxos) {
+            if (Settings::isZAddress(utxo.address) && utxo.confirmations < Settings::getInstance()->getReorgDepth()) {
+                zRecvSync->markDirty(utxo.address);
+            }
+        }
+
+        {
+            Tracer::Span span("ui", "update UI");
+            updateUI(utxoSet->anyUnconfirmed());
+        }
 
-            updateUI(anyTUnconfirmed || anyZUnconfirmed);    
-        });        
+        // What decoding the replies since the last refresh allocated
+        refreshAllocs.add(AllocStats::take());
     });
 }
 
+// Update the transactions table model, and trace it and the repaint that follows
+void RPC::updateTransactions(const QString& what, const std::function<void(void)>& update) {
+    {
+        Tracer::Span span("model", "transactions model: " % what);
+        update();
+    }
+    Tracer::getInstance()->repaint(ui->transactionsTable->viewport(), "transactions table");
+}
+
 void RPC::refreshTransactions() {    
     if  (conn == nullptr) 
         return noConnection();
 
-    getTransactions([=] (json reply) {
-        QList<TransactionItem> txdata;
-
-        for (auto& it : reply.get<json::array_t>()) {  
-            double fee = 0;
-            if (!it["fee"].is_null()) {
-                fee = it["fee"].get<json::number_float_t>();
-            }
-
-            TransactionItem tx{
-                QString::fromStdString(it["category"]),
-                (qint64)it["time"].get<json::number_unsigned_t>(),
-                (it["address"].is_null() ? "" : QString::fromStdString(it["address"])),
-                QString::fromStdString(it["txid"]),
-                it["amount"].get<json::number_float_t>() + fee,
-                (unsigned long)it["confirmations"].get<json::number_unsigned_t>(),
-                "", "" };
-
-            txdata.push_back(tx);
-        }
-
+    // Only the txs since the last synced block are fetched and merged into the history
+    txSync->sync([=] (QList<TransactionItem> txdata) {
         // Update model data, which updates the table view
-        transactionsTableModel->addTData(txdata);        
+        updateTransactions("t txs", [&] () { transactionsTableModel->addTData(txdata); });
     });
 }
 
@@ -769,34 +894,28 @@ void RPC::refreshSentZTrans() {
     }
 
     // Look up all the txids to get the confirmation count for them. 
-    conn->doBatchRPC<QString>(txids,
-        [=] (QString txid) {
-            json payload = {
-                {"jsonrpc", "1.0"},
-                {"id", "senttxid"},
-                {"method", "gettransaction"},
-                {"params", {txid.toStdString()}} 
-            };
-
-            return payload;
-        },          
+    getTxDetails(txids,
         [=] (QMap<QString, json>* txidList) {
             auto newSentZTxs = sentZTxs;
-            // Update the original sent list with the confirmation count
-            // TODO: This whole thing is kinda inefficient. We should probably just update the file
-            // with the confirmed block number, so we don't have to keep calling gettransaction for the
-            // sent items.
+            // Update the original sent list with the block it was mined in. Once mined, the tx cache
+            // remembers the block, so gettransaction is only called for the unmined sent items.
             for (TransactionItem& sentTx: newSentZTxs) {
-                auto j = txidList->value(sentTx.txid);
-                if (j.is_null())
+                RPCMethods::GetTransaction::Details details;
+                if (!RPCMethods::GetTransaction::details(txidList->value(sentTx.txid), details))
                     continue;
-                auto error = j["confirmations"].is_null();
-                if (!error)
-                    sentTx.confirmations = j["confirmations"].get<json::number_unsigned_t>();
+
+                // A conflicted tx (negative confirmations) isn't in the chain, so it counts as unconfirmed
+                sentTx.confirmations = details.confirmations > 0 ? (unsigned long)details.confirmations : 0;
+                sentTx.height        = heightFromConfirmations(details.confirmations);
+                sentTx.blockhash     = details.blockhash;
             }
             
-            transactionsTableModel->addZSentData(newSentZTxs);
+            updateTransactions("sent z txs", [&] () { transactionsTableModel->addZSentData(newSentZTxs); });
             delete txidList;
+        },
+        [=] (const RPCError& error) {
+            // The sent txs keep the confirmations they had, until the next refresh
+            qDebug() << "Couldn't look up the sent z txs:" << error.errorMessage();
         }
      );
 }
@@ -812,25 +931,24 @@ void RPC::watchTxStatus() {
         return noConnection();
 
     // Make an RPC to load pending operation statues
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "z_getoperationstatus"},
-    };
-
-    conn->doRPCIgnoreError(payload, [=] (const json& reply) {
-        // There's an array for each item in the status
-        for (auto& it : reply.get<json::array_t>()) {  
+    conn->call<RPCMethods::ZGetOperationStatus>({}, [=] (RPCMethods::ZGetOperationStatus::Result ops) {
+        // There's an item for each operation
+        for (auto& op : ops) {  
             // If we were watching this Tx and its status became "success", then we'll show a status bar alert
-            QString id = QString::fromStdString(it["id"]);
+            QString id = op.id;
             if (watchingOps.contains(id)) {
                 // And if it ended up successful
-                QString status = QString::fromStdString(it["status"]);
+                QString status = op.status;
                 if (status == "success") {
-                    auto txid = QString::fromStdString(it["result"]["txid"]);
+                    auto txid = op.txid;
                     
                     SentTxStore::addToSentTx(watchingOps.value(id), txid);
 
+                    // The from address spent some of its outputs, so re-read them. Only the primary
+                    // knows about the spend until it is mined.
+                    utxoSet->markDirty(watchingOps.value(id).fromAddr);
+                    conn->pinReadsToPrimary();
+
                     main->ui->statusBar->showMessage(Settings::txidStatusMessage + " " + txid);
                     main->loadingLabel->setVisible(false);
 
@@ -840,7 +958,7 @@ void RPC::watchTxStatus() {
                     refresh(true);  
                 } else if (status == "failed") {
                     // If it failed, then we'll actually show a warning. 
-                    auto errorMsg = QString::fromStdString(it["error"]["message"]);
+                    auto errorMsg = op.errorMessage;
                     QMessageBox msg(
                         QMessageBox::Critical,
                         "Transaction Error", 
@@ -857,12 +975,12 @@ void RPC::watchTxStatus() {
                     msg.exec();                                                  
                 } 
             }
+        }
 
-            if (watchingOps.isEmpty()) {
-                txTimer->start(Settings::updateSpeed);
-            } else {
-                txTimer->start(Settings::quickUpdateSpeed);
-            }
+        if (watchingOps.isEmpty()) {
+            scheduler->setInterval("txwatch", Settings::updateSpeed);
+        } else {
+            scheduler->setInterval("txwatch", Settings::quickUpdateSpeed);
         }
 
         // If there is some op that we are watching, then show the loading bar, otherwise hide it
@@ -872,6 +990,8 @@ void RPC::watchTxStatus() {
             main->loadingLabel->setVisible(true);
             main->loadingLabel->setToolTip(QString::number(watchingOps.size()) + " tx computing. This can take several minutes.");
         }
+    }, [=] (const RPCError&) {
+        // Ignored error handling
     });
 }
 
@@ -882,34 +1002,8 @@ void RPC::refreshMRCPrice() {
 
     QUrl cmcURL("https://api.coinmarketcap.com/v1/ticker/");
 
-    QNetworkRequest req;
-    req.setUrl(cmcURL);
-    
-    QNetworkReply *reply = conn->restclient->get(req);
-
-    QObject::connect(reply, &QNetworkReply::finished, [=] {
-        reply->deleteLater();
-
+    conn->doGet(cmcURL, [=] (json parsed) {
         try {
-            if (reply->error() != QNetworkReply::NoError) {
-                auto parsed = json::parse(reply->readAll(), nullptr, false);
-                if (!parsed.is_discarded() && !parsed["error"]["message"].is_null()) {
-                    qDebug() << QString::fromStdString(parsed["error"]["message"]);    
-                } else {
-                    qDebug() << reply->errorString();
-                }
-                Settings::getInstance()->setMRCPrice(0);
-                return;
-            } 
-
-            auto all = reply->readAll();
-            
-            auto parsed = json::parse(all, nullptr, false);
-            if (parsed.is_discarded()) {
-                Settings::getInstance()->setMRCPrice(0);
-                return;
-            }
-
             for (const json& item : parsed.get<json::array_t>()) {
                 if (item["symbol"].get<json::string_t>() == "ZEC") {
                     QString price = QString::fromStdString(item["price_usd"].get<json::string_t>());
@@ -926,6 +1020,9 @@ void RPC::refreshMRCPrice() {
 
         // If nothing, then set the price to 0;
         Settings::getInstance()->setMRCPrice(0);
+    }, [=] (const RPCError& error) {
+        qDebug() << error.errorMessage();
+        Settings::getInstance()->setMRCPrice(0);
     });
 }
 
@@ -936,13 +1033,9 @@ void RPC::shutdownMoonroomcashd() {
         return;
     }
 
-    json payload = {
-        {"jsonrpc", "1.0"},
-        {"id", "someid"},
-        {"method", "stop"}
-    };
-    
-    conn->doRPCWithDefaultErrorHandling(payload, [=](auto) {});
+    blockNotifier->stop();
+
+    conn->callWithDefaultErrorHandling<RPCMethods::Stop>({}, [=] (RPCMethods::None) {});
     conn->shutdown();
 
     QDialog d(main);
@@ -984,33 +1077,8 @@ void RPC::getZboardTopics(std::function<void(QMap<QString, QString>)> cb) {
 
     QUrl cmcURL("http://z-board.net/listTopics");
 
-    QNetworkRequest req;
-    req.setUrl(cmcURL);
-
-    QNetworkReply *reply = conn->restclient->get(req);
-
-    QObject::connect(reply, &QNetworkReply::finished, [=] {
-        reply->deleteLater();
-
+    conn->doGet(cmcURL, [=] (json parsed) {
         try {
-            if (reply->error() != QNetworkReply::NoError) {
-                auto parsed = json::parse(reply->readAll(), nullptr, false);
-                if (!parsed.is_discarded() && !parsed["error"]["message"].is_null()) {
-                    qDebug() << QString::fromStdString(parsed["error"]["message"]);
-                }
-                else {
-                    qDebug() << reply->errorString();
-                }
-                return;
-            }
-
-            auto all = reply->readAll();
-
-            auto parsed = json::parse(all, nullptr, false);
-            if (parsed.is_discarded()) {
-                return;
-            }
-
             QMap<QString, QString> topics;
             for (const json& item : parsed["topics"].get<json::array_t>()) {
                 if (item.find("addr") == item.end() || item.find("topicName") == item.end())
@@ -1028,6 +1096,8 @@ void RPC::getZboardTopics(std::function<void(QMap<QString, QString>)> cb) {
             // If anything at all goes wrong, just set the price to 0 and move on.
             qDebug() << QString("Caught something nasty");
         }
+    }, [=] (const RPCError& error) {
+        qDebug() << error.errorMessage();
     });
 }
 
@@ -12,6 +12,14 @@
 using json = nlohmann::json;
 
 class Turnstile;
+class TxCache;
+class TxSync;
+class ZRecvSync;
+class UTXOSet;
+class BlockNotifier;
+class RefreshScheduler;
+class MetricsServer;
+class MetricsWriter;
 
 struct TransactionItem {
     QString         type;
@@ -22,6 +30,8 @@ struct TransactionItem {
     unsigned long   confirmations;
     QString         fromAddr;
     QString         memo;
+    int             height;         // Block the tx was mined in, 0 if it is not mined yet
+    QString         blockhash;
 };
 
 class RPC
@@ -42,7 +52,7 @@ public:
     void getZboardTopics(std::function<void(QMap<QString, QString>)> cb);
 
     void fillTxJsonParams(json& params, Tx tx);
-    void sendZTransaction   (json params, const std::function<void(json)>& cb);
+    void sendZTransaction   (json params, const std::function<void(QString)>& cb);
     void watchTxStatus();
     void addNewTxToWatch(Tx tx, const QString& newOpid); 
 
@@ -51,20 +61,23 @@ public:
     const QList<UnspentOutput>*       getUTXOs()          { return utxos; }
     const QMap<QString, double>*      getAllBalances()    { return allBalances; }
 
-    void newZaddr(const std::function<void(json)>& cb);
-    void newTaddr(const std::function<void(json)>& cb);
+    void newZaddr(const std::function<void(QString)>& cb);
+    void newTaddr(const std::function<void(QString)>& cb);
 
-    void getZPrivKey(QString addr, const std::function<void(json)>& cb);
-    void getTPrivKey(QString addr, const std::function<void(json)>& cb);
-    void importZPrivKey(QString addr, bool rescan, const std::function<void(json)>& cb);
-    void importTPrivKey(QString addr, bool rescan, const std::function<void(json)>& cb);
+    RPCHandle getZPrivKey(QString addr, const std::function<void(QString)>& cb);
+    RPCHandle getTPrivKey(QString addr, const std::function<void(QString)>& cb);
+    void importZPrivKey(QString addr, bool rescan, const std::function<void(void)>& cb);
+    void importTPrivKey(QString addr, bool rescan, const std::function<void(void)>& cb);
 
     void shutdownMoonroomcashd();
     void noConnection();
 
     QString getDefaultSaplingAddress();
 
-    void getAllPrivKeys(const std::function<void(QList<QPair<QString, QString>>)>);
+    RPCHandle getAllPrivKeys(const std::function<void(QList<QPair<QString, QString>>)>);
+
+    void getTxDetails(const QList<QString>& txids, const std::function<void(QMap<QString, json>*)>& cb,
+                      const std::function<void(const RPCError&)>& ne);
 
     Turnstile*  getTurnstile()  { return turnstile; }
     Connection* getConnection() { return conn; }
@@ -76,17 +89,18 @@ private:
     void refreshSentZTrans();
     void refreshReceivedZTrans(QList<QString> zaddresses);
 
-    bool processUnspent     (const json& reply);
     void updateUI           (bool anyUnconfirmed);
+    void updateTransactions (const QString& what, const std::function<void(void)>& update);
 
     void getInfoThenRefresh(bool force);
+    QString walletFingerprint(const json& walletInfo, const QStringList& txids, const QList<json>& txs);
+
+    void getZAddresses          (const std::function<void(QList<QString>)>& cb);
 
-    void getBalance(const std::function<void(json)>& cb);
+    QList<json> prefetchNoteTxs (const json& notes);
+    QList<json> prefetchReceived(const json& addrs);
 
-    void getTransparentUnspent  (const std::function<void(json)>& cb);
-    void getZUnspent            (const std::function<void(json)>& cb);
-    void getTransactions        (const std::function<void(json)>& cb);
-    void getZAddresses          (const std::function<void(json)>& cb);
+    void writeMetrics(MetricsWriter& out);
 
     Connection*                 conn                        = nullptr;
     QProcess*                   emoonroomcashd              = nullptr;
@@ -100,13 +114,28 @@ private:
     TxTableModel*               transactionsTableModel      = nullptr;
     BalancesTableModel*         balancesTableModel          = nullptr;
 
-    QTimer*                     timer;
-    QTimer*                     txTimer;
-    QTimer*                     priceTimer;
+    RefreshScheduler*           scheduler;
 
     Ui::MainWindow*             ui;
     MainWindow*                 main;
     Turnstile*                  turnstile;
+    TxCache*                    txCache;
+    TxSync*                     txSync;
+    ZRecvSync*                  zRecvSync;
+    UTXOSet*                    utxoSet;
+    BlockNotifier*              blockNotifier;
+    MetricsServer*              metricsServer               = nullptr;
+
+    // Block hashes that were checked against moonroomcashd at the current block, used to detect reorgs
+    QMap<int, QString>          verifiedBlockHashes;
+    int                         verifiedAtBlock             = 0;
+
+    // Summary of the wallet's state at the last refresh. The full refresh is skipped while it stays the same
+    QString                     lastFingerprint;
+    int                         refreshesRun                = 0;
+    int                         refreshesSkipped            = 0;
+    LatencyHistogram            refreshTimes;
+    AllocStats                  refreshAllocs;              // Totals of every refresh, for the metrics
 
     // Current balance in the UI. If this number updates, then refresh the UI
     QString                     currentBalance;
@@ -0,0 +1,80 @@
+#ifndef RPCHANDLE_H
+#define RPCHANDLE_H
+
+#include "precompiled.h"
+
+/**
+ * Cancels a request, or a batch of them, that was already handed to Connection.
+ *
+ * Cancelling drops the requests that are still waiting to be sent and aborts the ones in flight, so
+ * moonroomcashd doesn't keep working on replies nobody is waiting for. The callbacks of a cancelled
+ * request are never called, not even the error callback.
+ *
+ * Copies share the same state, so the handle can be passed around freely. cancelWith() ties it to
+ * a QObject, usually the dialog or widget that shows the result, and cancels it when that is destroyed.
+ * A handle can also adopt others, for eg. the calls that make up a bigger job, which are cancelled with it.
+ *
+ * Cancelled is checked on any thread, but cancel(), cancelWith() and adopt() are only used on the UI thread.
+ */
+class RPCHandle {
+public:
+    RPCHandle() : state(std::make_shared<State>()) {}
+
+    bool isCancelled() const { return state->cancelled.load(); }
+
+    void cancel() const {
+        if (state->cancelled.exchange(true))
+            return;
+
+        auto callbacks = state->onCancel;
+        state->onCancel.clear();
+        for (auto& fn : callbacks) {
+            fn();
+        }
+    }
+
+    // Run fn when this is cancelled, right away if it already was
+    void onCancel(const std::function<void(void)>& fn) const {
+        if (isCancelled())
+            fn();
+        else
+            state->onCancel.push_back(fn);
+    }
+
+    // Cancel this when owner is destroyed
+    const RPCHandle& cancelWith(QObject* owner) const {
+        auto s = state;
+        QObject::connect(owner, &QObject::destroyed, [=] () {
+            RPCHandle(s).cancel();
+        });
+        return *this;
+    }
+
+    // Cancel child along with this
+    void adopt(const RPCHandle& child) const {
+        onCancel([=] () { child.cancel(); });
+    }
+
+    // Wrap fn so it doesn't run once this is cancelled
+    template<class... Args>
+    std::function<void(Args...)> unlessCancelled(const std::function<void(Args...)>& fn) const {
+        auto s = state;
+        return [=] (Args... args) {
+            if (s->cancelled.load())
+                return;
+            fn(args...);
+        };
+    }
+
+private:
+    struct State {
+        std::atomic<bool>                   cancelled { false };
+        QList<std::function<void(void)>>    onCancel;
+    };
+
+    explicit RPCHandle(const std::shared_ptr<State>& s) : state(s) {}
+
+    std::shared_ptr<State> state;
+};
+
+#endif // RPCHANDLE_H
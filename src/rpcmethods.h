@@ -0,0 +1,686 @@
+#ifndef RPCMETHODS_H
+#define RPCMETHODS_H
+
+#include "precompiled.h"
+#include "rpcworker.h"
+#include "fastjson.h"
+
+using json = nlohmann::json;
+
+/**
+ * One descriptor for each moonroomcashd method the wallet calls. A descriptor has the method's
+ * name(), its Params (which build the JSON params array), its Result and a decode() that fills the
+ * Result from the reply's "result". decode() returns false instead of throwing if the reply doesn't
+ * have the expected shape, so a changed reply is reported as an error instead of crashing.
+ *
+ * Use them with Connection::call<M>(), or build batch payloads with payload<M>() and decode each
+ * reply with result<M>().
+ */
+namespace RPCMethods {
+
+//
+// Safe lookups. These return false if the key is missing or has the wrong type.
+//
+
+inline bool get(const json& obj, const char* key, QString& out) {
+    if (!obj.is_object()) return false;
+    auto it = obj.find(key);
+    if (it == obj.end() || !it->is_string()) return false;
+    out = QString::fromStdString(it->get_ref<const json::string_t&>());
+    return true;
+}
+
+inline bool get(const json& obj, const char* key, qint64& out) {
+    if (!obj.is_object()) return false;
+    auto it = obj.find(key);
+    if (it == obj.end() || !it->is_number_integer()) return false;
+    out = it->get<qint64>();
+    return true;
+}
+
+inline bool get(const json& obj, const char* key, int& out) {
+    qint64 value;
+    if (!get(obj, key, value)) return false;
+    out = (int)value;
+    return true;
+}
+
+inline bool get(const json& obj, const char* key, double& out) {
+    if (!obj.is_object()) return false;
+    auto it = obj.find(key);
+    if (it == obj.end() || !it->is_number()) return false;
+    out = it->get<double>();
+    return true;
+}
+
+inline bool get(const json& obj, const char* key, bool& out) {
+    if (!obj.is_object()) return false;
+    auto it = obj.find(key);
+    if (it == obj.end() || !it->is_boolean()) return false;
+    out = it->get<bool>();
+    return true;
+}
+
+inline bool decodeString(const json& r, QString& out) {
+    if (!r.is_string()) return false;
+    out = QString::fromStdString(r.get_ref<const json::string_t&>());
+    return true;
+}
+
+inline bool decodeStrings(const json& r, QList<QString>& out) {
+    if (!r.is_array()) return false;
+    for (auto& it : r) {
+        if (!it.is_string()) return false;
+        out.push_back(QString::fromStdString(it.get_ref<const json::string_t&>()));
+    }
+    return true;
+}
+
+// One output or note, the same fields FastJson::unspentFromJson decodes
+inline bool decodeUnspent(const json& r, QList<UnspentRecord>& out) {
+    if (!r.is_array()) return false;
+    for (auto& it : r) {
+        UnspentRecord u;
+        if (!get(it, "txid", u.txid) || !get(it, "amount", u.amount))
+            return false;
+
+        get(it, "address",       u.address);
+        get(it, "memo",          u.memo);
+        get(it, "confirmations", u.confirmations);
+        get(it, "spendable",     u.spendable);
+        get(it, "vout",          u.vout);
+        get(it, "jsindex",       u.jsindex);
+        get(it, "jsoutindex",    u.jsoutindex);
+        get(it, "outindex",      u.outindex);
+        out.push_back(u);
+    }
+    return true;
+}
+
+// Amounts come as numbers or as decimal strings. In zatoshis, -1 if it isn't an amount.
+inline qint64 toZats(const json& obj, const char* key) {
+    if (!obj.is_object()) return -1;
+    auto it = obj.find(key);
+    if (it == obj.end()) return -1;
+    if (it->is_number()) return qRound64(it->get<double>() * 100000000);
+    if (it->is_string()) return qRound64(QString::fromStdString(it->get_ref<const json::string_t&>()).toDouble() * 100000000);
+    return -1;
+}
+
+struct NoParams {
+    json toJson() const { return json(); }
+};
+
+// For methods whose result we don't look at
+struct None {};
+
+//
+// Payloads and batch replies
+//
+
+template<class M>
+json payload(const typename M::Params& params = typename M::Params()) {
+    json p = {
+        {"jsonrpc", "1.0"},
+        {"method", M::name()}
+    };
+
+    json args = params.toJson();
+    if (!args.is_null())
+        p["params"] = args;
+
+    return p;
+}
+
+// Decode one reply of a batch (the whole reply, with "result" and "error"). Returns false if the
+// call failed or the result didn't decode.
+template<class M>
+bool result(const json& reply, typename M::Result& out) {
+    if (!reply.is_object())
+        return false;
+
+    auto error = reply.find("error");
+    if (error != reply.end() && !error->is_null())
+        return false;
+
+    auto r = reply.find("result");
+    return r != reply.end() && M::decode(*r, out);
+}
+
+//
+// Chain and node
+//
+
+struct GetInfo {
+    static const char* name() { return "getinfo"; }
+    typedef NoParams Params;
+
+    struct Result {
+        int     blocks      = 0;
+        int     connections = 0;
+        bool    testnet     = false;
+        bool    hasTestnet  = false;
+    };
+
+    static bool decode(const json& r, Result& out) {
+        get(r, "connections", out.connections);
+        out.hasTestnet = get(r, "testnet", out.testnet);
+        return get(r, "blocks", out.blocks);
+    }
+};
+
+struct GetBlockchainInfo {
+    static const char* name() { return "getblockchaininfo"; }
+    typedef NoParams Params;
+
+    struct Result {
+        int     blocks                  = 0;
+        double  verificationProgress    = 0;
+        int     estimatedHeight         = 0;        // 0 if moonroomcashd didn't say
+        QString bestBlockHash;                      // The block at blocks, empty if moonroomcashd didn't say
+    };
+
+    static bool decode(const json& r, Result& out) {
+        get(r, "estimatedheight", out.estimatedHeight);
+        get(r, "bestblockhash", out.bestBlockHash);
+        return get(r, "blocks", out.blocks) && get(r, "verificationprogress", out.verificationProgress);
+    }
+};
+
+struct GetNetworkSolps {
+    static const char* name() { return "getnetworksolps"; }
+    typedef NoParams Params;
+    typedef qint64   Result;
+
+    static bool decode(const json& r, Result& out) {
+        if (!r.is_number()) return false;
+        out = r.is_number_integer() ? r.get<qint64>() : (qint64)r.get<double>();
+        return true;
+    }
+};
+
+struct GetBlockCount {
+    static const char* name() { return "getblockcount"; }
+    typedef NoParams Params;
+    typedef int      Result;
+
+    static bool decode(const json& r, Result& out) {
+        if (!r.is_number_integer()) return false;
+        out = r.get<int>();
+        return true;
+    }
+};
+
+// Waits until there is a new block, or the timeout (ms) runs out. The current tip either way.
+struct WaitForNewBlock {
+    static const char* name() { return "waitfornewblock"; }
+
+    struct Params {
+        int timeout;
+        json toJson() const { return json::array({ timeout }); }
+    };
+
+    struct Result {
+        int     height = 0;
+        QString hash;
+    };
+
+    static bool decode(const json& r, Result& out) {
+        get(r, "hash", out.hash);
+        return get(r, "height", out.height);
+    }
+};
+
+struct GetBlockHash {
+    static const char* name() { return "getblockhash"; }
+    typedef QString Result;
+
+    struct Params {
+        int height;
+        json toJson() const { return json::array({ height }); }
+    };
+
+    static bool decode(const json& r, Result& out) { return decodeString(r, out); }
+};
+
+struct Stop {
+    static const char* name() { return "stop"; }
+    typedef NoParams Params;
+    typedef None     Result;
+
+    static bool decode(const json&, Result&) { return true; }
+};
+
+//
+// Wallet
+//
+
+struct GetWalletInfo {
+    static const char* name() { return "getwalletinfo"; }
+    typedef NoParams Params;
+
+    // The balances are in zatoshis, -1 if moonroomcashd didn't send them
+    struct Result {
+        qint64  txCount                     = 0;
+        qint64  balance                     = -1;
+        qint64  unconfirmedBalance          = -1;
+        qint64  immatureBalance             = -1;
+        qint64  shieldedBalance             = -1;
+        qint64  shieldedUnconfirmedBalance  = -1;
+    };
+
+    static bool decode(const json& r, Result& out) {
+        out.balance                     = toZats(r, "balance");
+        out.unconfirmedBalance          = toZats(r, "unconfirmed_balance");
+        out.immatureBalance             = toZats(r, "immature_balance");
+        out.shieldedBalance             = toZats(r, "shielded_balance");
+        out.shieldedUnconfirmedBalance  = toZats(r, "shielded_unconfirmed_balance");
+        return get(r, "txcount", out.txCount);
+    }
+};
+
+struct ZGetTotalBalance {
+    static const char* name() { return "z_gettotalbalance"; }
+
+    struct Params {
+        int minconf;
+        json toJson() const { return json::array({ minconf }); }
+    };
+
+    // In zatoshis
+    struct Result {
+        qint64  transparent = -1;
+        qint64  shielded    = -1;
+        qint64  total       = -1;
+    };
+
+    static bool decode(const json& r, Result& out) {
+        out.transparent = toZats(r, "transparent");
+        out.shielded    = toZats(r, "private");
+        out.total       = toZats(r, "total");
+        return out.transparent >= 0 && out.shielded >= 0 && out.total >= 0;
+    }
+};
+
+// The big replies are usually streamed into these records with Connection::doRPCArrayRecords (see
+// BatchReply), and decode() is for when they come as JSON.
+struct ListUnspent {
+    static const char* name() { return "listunspent"; }
+    typedef QList<UnspentRecord> Result;
+
+    struct Params {
+        int             minconf;
+        int             maxconf;        // -1 for no limit
+        QList<QString>  addresses;      // Empty for all of them
+
+        json toJson() const {
+            json args = json::array({ minconf });
+            if (maxconf >= 0 || !addresses.isEmpty())
+                args.push_back(maxconf >= 0 ? maxconf : 9999999);
+            if (!addresses.isEmpty()) {
+                json addrs = json::array();
+                for (auto& addr : addresses) addrs.push_back(addr.toStdString());
+                args.push_back(addrs);
+            }
+            return args;
+        }
+    };
+
+    static bool decode(const json& r, Result& out) { return decodeUnspent(r, out); }
+};
+
+struct ZListUnspent {
+    static const char* name() { return "z_listunspent"; }
+    typedef QList<UnspentRecord> Result;
+
+    struct Params {
+        int             minconf;
+        int             maxconf;        // -1 for no limit
+        QList<QString>  addresses;      // Empty for all of them
+
+        json toJson() const {
+            json args = json::array({ minconf });
+            if (maxconf >= 0 || !addresses.isEmpty())
+                args.push_back(maxconf >= 0 ? maxconf : 9999999);
+            if (!addresses.isEmpty()) {
+                json addrs = json::array();
+                for (auto& addr : addresses) addrs.push_back(addr.toStdString());
+                args.push_back(false);          // includeWatchonly
+                args.push_back(addrs);
+            }
+            return args;
+        }
+    };
+
+    static bool decode(const json& r, Result& out) { return decodeUnspent(r, out); }
+};
+
+// Streamed as TxRecords in BatchReply::transactions, with the rest of the result left as JSON
+struct ListSinceBlock {
+    static const char* name() { return "listsinceblock"; }
+
+    struct Params {
+        QString blockhash;              // Empty for the whole history
+
+        json toJson() const {
+            return blockhash.isEmpty() ? json() : json::array({ blockhash.toStdString() });
+        }
+    };
+
+    struct Result {
+        QList<TxRecord> transactions;
+        QString         lastBlock;
+    };
+
+    static bool decode(const json& r, Result& out) {
+        if (!r.is_object()) return false;
+        auto txs = r.find("transactions");
+        if (txs == r.end() || !txs->is_array()) return false;
+
+        for (auto& it : *txs) {
+            TxRecord tx;
+            if (!get(it, "txid", tx.txid) || !get(it, "category", tx.category))
+                return false;
+
+            get(it, "address",       tx.address);
+            get(it, "memo",          tx.memo);
+            get(it, "blockhash",     tx.blockhash);
+            get(it, "amount",        tx.amount);
+            get(it, "fee",           tx.fee);
+            get(it, "confirmations", tx.confirmations);
+            get(it, "time",          tx.time);
+            get(it, "vout",          tx.vout);
+            out.transactions.push_back(tx);
+        }
+
+        get(r, "lastblock", out.lastBlock);
+        return true;
+    }
+};
+
+// The tx cache keeps the whole reply, so it is only decoded further with details()
+struct GetTransaction {
+    static const char* name() { return "gettransaction"; }
+    typedef json Result;
+
+    struct Params {
+        QString txid;
+        json toJson() const { return json::array({ txid.toStdString() }); }
+    };
+
+    static bool decode(const json& r, Result& out) {
+        if (!r.is_object()) return false;
+        out = r;
+        return true;
+    }
+
+    // What the tx lists show, from a result or a cached one
+    struct Details {
+        qint64  confirmations   = 0;        // Negative if the tx conflicts with one in the chain
+        qint64  time            = 0;
+        QString blockhash;                  // Empty if it isn't mined
+    };
+
+    static bool details(const json& r, Details& out) {
+        if (!get(r, "confirmations", out.confirmations))
+            return false;
+
+        if (!get(r, "time", out.time))
+            get(r, "blocktime", out.time);
+        get(r, "blockhash", out.blockhash);
+        return true;
+    }
+};
+
+struct ZListReceivedByAddress {
+    static const char* name() { return "z_listreceivedbyaddress"; }
+
+    struct Params {
+        QString address;
+        int     minconf;
+        json toJson() const { return json::array({ address.toStdString(), minconf }); }
+    };
+
+    struct Note {
+        QString txid;
+        double  amount  = 0;
+        QString memo;                   // Hex
+        bool    change  = false;
+    };
+    typedef QList<Note> Result;
+
+    static bool decode(const json& r, Result& out) {
+        if (!r.is_array()) return false;
+        for (auto& it : r) {
+            Note note;
+            if (!get(it, "txid", note.txid) || !get(it, "amount", note.amount))
+                return false;
+
+            get(it, "memo",   note.memo);
+            get(it, "change", note.change);
+            out.push_back(note);
+        }
+        return true;
+    }
+};
+
+struct ZGetOperationStatus {
+    static const char* name() { return "z_getoperationstatus"; }
+    typedef NoParams Params;
+
+    struct Operation {
+        QString id;
+        QString status;             // "queued", "executing", "success", "failed", ...
+        QString txid;               // If it succeeded
+        QString errorMessage;       // If it failed
+    };
+    typedef QList<Operation> Result;
+
+    static bool decode(const json& r, Result& out) {
+        if (!r.is_array()) return false;
+        for (auto& it : r) {
+            Operation op;
+            if (!get(it, "id", op.id) || !get(it, "status", op.status))
+                return false;
+
+            if (it.find("result") != it.end())
+                get(it["result"], "txid", op.txid);
+            if (it.find("error") != it.end())
+                get(it["error"], "message", op.errorMessage);
+
+            out.push_back(op);
+        }
+        return true;
+    }
+};
+
+struct ZSendMany {
+    static const char* name() { return "z_sendmany"; }
+    typedef QString Result;         // The operation id
+
+    struct Params {
+        json args;                  // See RPC::fillTxJsonParams
+        json toJson() const { return args; }
+    };
+
+    static bool decode(const json& r, Result& out) { return decodeString(r, out); }
+};
+
+//
+// Addresses and keys
+//
+
+struct ZListAddresses {
+    static const char* name() { return "z_listaddresses"; }
+    typedef NoParams        Params;
+    typedef QList<QString>  Result;
+
+    static bool decode(const json& r, Result& out) { return decodeStrings(r, out); }
+};
+
+struct GetAddressesByAccount {
+    static const char* name() { return "getaddressesbyaccount"; }
+    typedef QList<QString> Result;
+
+    struct Params {
+        QString account;
+        json toJson() const { return json::array({ account.toStdString() }); }
+    };
+
+    static bool decode(const json& r, Result& out) { return decodeStrings(r, out); }
+};
+
+struct GetNewAddress {
+    static const char* name() { return "getnewaddress"; }
+    typedef NoParams Params;
+    typedef QString  Result;
+
+    static bool decode(const json& r, Result& out) { return decodeString(r, out); }
+};
+
+struct ZGetNewAddress {
+    static const char* name() { return "z_getnewaddress"; }
+    typedef NoParams Params;
+    typedef QString  Result;
+
+    static bool decode(const json& r, Result& out) { return decodeString(r, out); }
+};
+
+struct DumpPrivKey {
+    static const char* name() { return "dumpprivkey"; }
+    typedef QString Result;
+
+    struct Params {
+        QString address;
+        json toJson() const { return json::array({ address.toStdString() }); }
+    };
+
+    static bool decode(const json& r, Result& out) { return decodeString(r, out); }
+};
+
+struct ZExportKey {
+    static const char* name() { return "z_exportkey"; }
+    typedef DumpPrivKey::Params Params;
+    typedef QString             Result;
+
+    static bool decode(const json& r, Result& out) { return decodeString(r, out); }
+};
+
+struct ImportPrivKey {
+    static const char* name() { return "importprivkey"; }
+    typedef None Result;
+
+    struct Params {
+        QString key;
+        bool    rescan;
+        json toJson() const { return json::array({ key.toStdString(), rescan ? "yes" : "no" }); }
+    };
+
+    static bool decode(const json&, Result&) { return true; }
+};
+
+struct ZImportKey {
+    static const char* name() { return "z_importkey"; }
+    typedef ImportPrivKey::Params   Params;
+    typedef None                    Result;
+
+    static bool decode(const json&, Result&) { return true; }
+};
+
+/**
+ * Read only methods, whose identical in-flight calls can share one reply
+ */
+inline bool isShareable(const QString& method) {
+    static const QSet<QString> shareable = {
+        GetInfo::name(), GetBlockchainInfo::name(), GetNetworkSolps::name(), ZListAddresses::name(),
+        GetAddressesByAccount::name(), ListUnspent::name(), ZListUnspent::name(), ZGetTotalBalance::name(),
+        GetTransaction::name(), ZListReceivedByAddress::name(), DumpPrivKey::name(),
+        ZExportKey::name(), GetBlockHash::name(), ListSinceBlock::name()
+    };
+
+    return shareable.contains(method);
+}
+
+/**
+ * Read only methods that any node with the wallet answers the same way, so they can be sent to a replica
+ * once it has caught up with the primary (see NodePool). The keys, the operations and the block hashes
+ * the reorg checks compare only come from the primary.
+ *
+ * getblockchaininfo is in here so the unspent outputs can be sent along with the tip they are at. A
+ * batch only goes to a replica if all of its calls can, so in the other batches it stays on the primary.
+ */
+inline bool isReplicable(const QString& method) {
+    static const QSet<QString> replicable = {
+        ZListAddresses::name(), GetAddressesByAccount::name(), ListUnspent::name(), ZListUnspent::name(),
+        ZGetTotalBalance::name(), GetTransaction::name(), ZListReceivedByAddress::name(), GetNetworkSolps::name(),
+        GetBlockchainInfo::name()
+    };
+
+    return replicable.contains(method);
+}
+
+/**
+ * Which class a call is sent in, see RPCPriority. The keys go in the Export class, since they are
+ * mostly read and imported in bulk, and an import with a rescan takes minutes.
+ */
+inline RPCPriority priority(const QString& method) {
+    static const QSet<QString> interactive = {
+        ZSendMany::name(), GetNewAddress::name(), ZGetNewAddress::name(), Stop::name()
+    };
+    static const QSet<QString> bulk = {
+        DumpPrivKey::name(), ZExportKey::name(), ImportPrivKey::name(), ZImportKey::name()
+    };
+
+    if (interactive.contains(method))
+        return Interactive;
+    if (method == ZGetOperationStatus::name())
+        return TxWatch;
+    if (bulk.contains(method))
+        return Export;
+    if (method == WaitForNewBlock::name())
+        return Unbounded;
+    return Refresh;
+}
+
+/**
+ * Reads whose reply grows with the wallet: the full tx history, all the unspent outputs, all the
+ * notes of an address. moonroomcashd builds the whole reply before it sends any of it, so on a big
+ * wallet these can take minutes on a node that is only busy.
+ */
+inline bool isBulkRead(const QString& method) {
+    static const QSet<QString> bulkReads = {
+        ListSinceBlock::name(), ListUnspent::name(), ZListUnspent::name(), ZListReceivedByAddress::name()
+    };
+
+    return bulkReads.contains(method);
+}
+
+/**
+ * How long to wait for a reply to start arriving before giving up on a call, in ms. 0 is forever,
+ * for the imports, since a rescan can take hours.
+ */
+inline int timeout(const QString& method) {
+    if (method == ImportPrivKey::name() || method == ZImportKey::name())
+        return 0;
+    if (isBulkRead(method))
+        return 10 * 60 * 1000;
+    if (method == WaitForNewBlock::name())
+        return 90 * 1000;       // Longer than the long poll waits
+    if (method == ZSendMany::name())
+        return 60 * 1000;
+    if (method == Stop::name() || method == GetBlockCount::name())
+        return 10 * 1000;
+    return 30 * 1000;
+}
+
+/**
+ * A call that timed out only says moonroomcashd is down if it should have answered quickly, so the
+ * bulk reads and the Export class don't count towards opening the CircuitBreaker.
+ */
+inline bool timeoutMeansDown(const QString& method) {
+    return !isBulkRead(method) && priority(method) != Export;
+}
+
+}   // namespace RPCMethods
+
+#endif // RPCMETHODS_H
@@ -0,0 +1,122 @@
+#include "rpcstats.h"
+#include "metricsserver.h"
+
+// The bucket of a reply time: 4 buckets from every power of 2 to the next
+static int bucketOf(qint64 ms) {
+    if (ms < 1)
+        return 0;
+
+    int bucket = (int)(4 * std::log2((double)ms)) + 1;
+    if (bucket >= LatencyHistogram::numBuckets)
+        return LatencyHistogram::numBuckets - 1;
+
+    return bucket;
+}
+
+// The longest reply time in the bucket
+static qint64 upperBound(int bucket) {
+    if (bucket == 0)
+        return 0;
+
+    return (qint64)std::ceil(std::pow(2.0, bucket / 4.0));
+}
+
+void LatencyHistogram::add(qint64 ms) {
+    buckets[bucketOf(ms)]++;
+    total++;
+    totalMs += ms;
+}
+
+qint64 LatencyHistogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+
+    qint64 rank = (qint64)std::ceil(p * total);
+    if (rank < 1)
+        rank = 1;
+
+    qint64 seen = 0;
+    for (int i = 0; i < numBuckets; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return upperBound(i);
+    }
+
+    return upperBound(numBuckets - 1);
+}
+
+void RPCStats::record(const QString& method, int calls, qint64 ms, qint64 requestBytes, qint64 responseBytes,
+                      bool failed, int retries) {
+    auto& s = stats[method];
+    s.calls         += calls;
+    s.retries       += retries;
+    s.requestBytes  += requestBytes;
+    s.responseBytes += responseBytes;
+    if (failed)
+        s.errors += calls;
+
+    s.latency.add(ms);
+}
+
+void RPCStats::recordErrors(const QString& method, int calls) {
+    stats[method].errors += calls;
+}
+
+void RPCStats::recordShared(const QString& method) {
+    stats[method].shared++;
+}
+
+void RPCStats::recordPrefetched(const QString& method) {
+    stats[method].prefetched++;
+}
+
+void RPCStats::recordPrefetchExpired(const QString& method) {
+    stats[method].prefetchExpired++;
+}
+
+QString RPCStats::report() const {
+    QString out = "RPC stats: method, calls, errors, retries, shared, prefetched, expired, p50/p90/p99 ms, bytes sent, bytes received";
+    for (auto it = stats.constBegin(); it != stats.constEnd(); it++) {
+        auto& s = it.value();
+        out = out % "\n" % it.key() % ", " % QString::number(s.calls) % ", " % QString::number(s.errors)
+                  % ", " % QString::number(s.retries) % ", " % QString::number(s.shared)
+                  % ", " % QString::number(s.prefetched) % ", " % QString::number(s.prefetchExpired)
+                  % ", " % QString::number(s.latency.percentile(0.5)) % "/" % QString::number(s.latency.percentile(0.9))
+                  % "/" % QString::number(s.latency.percentile(0.99))
+                  % ", " % QString::number(s.requestBytes) % ", " % QString::number(s.responseBytes);
+    }
+
+    return out;
+}
+
+// The same numbers as report(), for the metrics endpoint
+void RPCStats::writeMetrics(MetricsWriter& out) const {
+    struct Counter {
+        const char* name;
+        const char* help;
+        qint64 MethodStats::* field;
+    };
+
+    static const Counter counters[] = {
+        { "mrc_wallet_rpc_calls_total",            "Calls made to moonroomcashd",                               &MethodStats::calls },
+        { "mrc_wallet_rpc_errors_total",           "Calls that failed",                                         &MethodStats::errors },
+        { "mrc_wallet_rpc_retries_total",          "Times a request with these calls was sent again",           &MethodStats::retries },
+        { "mrc_wallet_rpc_shared_total",           "Calls answered by an identical request already in flight",  &MethodStats::shared },
+        { "mrc_wallet_rpc_prefetched_total",       "Calls answered by the prefetcher",                          &MethodStats::prefetched },
+        { "mrc_wallet_rpc_prefetch_expired_total", "Prefetched replies that expired before they were used",     &MethodStats::prefetchExpired },
+        { "mrc_wallet_rpc_request_bytes_total",    "Bytes sent",                                                &MethodStats::requestBytes },
+        { "mrc_wallet_rpc_response_bytes_total",   "Bytes received, with a batch split over its calls",         &MethodStats::responseBytes },
+    };
+
+    for (auto& counter : counters) {
+        out.family(counter.name, "counter", counter.help);
+        for (auto it = stats.constBegin(); it != stats.constEnd(); it++) {
+            out.sample(counter.name, it.value().*counter.field, MetricLabels{ qMakePair(QString("method"), it.key()) });
+        }
+    }
+
+    out.family("mrc_wallet_rpc_latency_seconds", "summary", "Time of the request or batch the calls went in");
+    for (auto it = stats.constBegin(); it != stats.constEnd(); it++) {
+        out.summary("mrc_wallet_rpc_latency_seconds", it.value().latency, MetricLabels{ qMakePair(QString("method"), it.key()) });
+    }
+}
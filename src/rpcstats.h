@@ -0,0 +1,67 @@
+#ifndef RPCSTATS_H
+#define RPCSTATS_H
+
+#include "precompiled.h"
+
+class MetricsWriter;
+
+/**
+ * Reply times in buckets that grow exponentially, 4 to every doubling, so the percentiles are within
+ * about 20% of the real ones without keeping every sample.
+ */
+class LatencyHistogram {
+public:
+    void    add(qint64 ms);
+    qint64  percentile(double p) const;     // In ms, p between 0 and 1. 0 if nothing was added.
+    qint64  count() const { return total; }
+    qint64  sum()   const { return totalMs; }   // Of all the reply times, in ms
+
+    static const int numBuckets = 80;       // Up to 2^20 ms, about 17 minutes
+
+private:
+    qint64  buckets[numBuckets] = {};
+    qint64  total = 0;
+    qint64  totalMs = 0;
+};
+
+struct MethodStats {
+    qint64  calls           = 0;
+    qint64  errors          = 0;
+    qint64  retries         = 0;
+    qint64  shared          = 0;        // Got the reply of an identical request already in flight
+    qint64  prefetched      = 0;        // Got the reply from the Prefetcher
+    qint64  prefetchExpired = 0;        // Prefetched, but expired before anything asked for it
+    qint64  requestBytes    = 0;
+    qint64  responseBytes   = 0;        // Of a batch, split over its calls
+
+    LatencyHistogram latency;           // Of the request (or batch) the calls went in
+};
+
+/**
+ * Counts the calls to every RPC method, how long they took and how big they were, so it can be
+ * seen which ones the refreshes spend their time on. Connection records every request here, and
+ * doBatchRPC the calls that didn't need to be sent.
+ *
+ * Only used on the UI thread.
+ */
+class RPCStats {
+public:
+    void    record(const QString& method, int calls, qint64 ms, qint64 requestBytes, qint64 responseBytes,
+                   bool failed, int retries);
+    void    recordErrors    (const QString& method, int calls);     // Calls of a batch that returned an error
+    void    recordShared    (const QString& method);
+    void    recordPrefetched(const QString& method);
+    void    recordPrefetchExpired(const QString& method);
+
+    const QMap<QString, MethodStats>& methods() const { return stats; }
+
+    QString report() const;                 // A table of all the methods, for the log
+    void    reset() { stats.clear(); }
+
+    void    writeMetrics(MetricsWriter& out) const;
+
+private:
+    QMap<QString, MethodStats>  stats;
+};
+
+#endif // RPCSTATS_H
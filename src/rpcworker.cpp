@@ -0,0 +1,408 @@
+#include "rpcworker.h"
+
+using json = nlohmann::json;
+
+// Requests in flight for each RPCPriority. For Refresh and Export, this is where their ConcurrencyLimiter starts.
+static const int maxInFlight[NumPriorities] = {
+    1,      // Interactive
+    1,      // TxWatch
+    2,      // Refresh
+    1,      // Export
+    0       // Unbounded
+};
+
+// Requests turned away because moonroomcashd's work queue is full are tried again this many times
+static const int maxRetries = 5;
+
+// ...and idempotent requests that timed out or lost the connection, this many times
+static const int maxTransientRetries = 2;
+
+static int randomInt(int max) {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+    return (int)QRandomGenerator::global()->bounded(max);
+#else
+    return qrand() % max;
+#endif
+}
+
+// The connection failed, but the same request might go through if it is sent again
+static bool isTransient(QNetworkReply::NetworkError code) {
+    return code == QNetworkReply::TimeoutError || code == QNetworkReply::RemoteHostClosedError ||
+           code == QNetworkReply::TemporaryNetworkFailureError || code == QNetworkReply::UnknownNetworkError;
+}
+
+// moonroomcashd turns a request away with this when more are queued than -rpcworkqueue allows
+static bool isWorkQueueFull(QNetworkReply* reply, const QByteArray& body) {
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return (status == 500 || status == 503) && body.contains("Work queue depth exceeded");
+}
+
+// What the handler of a cancelled request gets
+static RPCError cancelled() {
+    return RPCError{ QNetworkReply::OperationCanceledError, "Cancelled", json() };
+}
+
+QString RPCError::errorMessage() const {
+    if (body.is_object()) {
+        auto error = body.find("error");
+        if (error != body.end() && error->is_object()) {
+            auto msg = error->find("message");
+            if (msg != error->end() && msg->is_string())
+                return QString::fromStdString(msg->get<json::string_t>());
+        }
+    }
+
+    return message;
+}
+
+RPCWorker::RPCWorker() {
+    alive = std::make_shared<bool>(true);
+
+    uiContext  = new QObject();
+    netContext = new QObject();
+    netThread  = new QThread();
+    netThread->setObjectName("RPC network");
+
+    // QNetworkAccessManager opens at most 6 connections to a host. Refresh and Export can have 5 of
+    // them between them, and the long poll the last one. Interactive and TxWatch have their own manager.
+    limiters[Refresh].reset(new ConcurrencyLimiter(maxInFlight[Refresh], 1, 4));
+    limiters[Export] .reset(new ConcurrencyLimiter(maxInFlight[Export],  1, 1));
+
+    netContext->moveToThread(netThread);
+    QObject::connect(netThread, &QThread::finished, netContext, &QObject::deleteLater);
+
+    netThread->start();
+}
+
+RPCWorker::~RPCWorker() {
+    *alive = false;
+
+    // This also deletes the network context, along with the QNetworkAccessManager and any replies
+    netThread->quit();
+    netThread->wait();
+
+    delete netThread;
+    delete uiContext;
+}
+
+// Run fn on the thread that context lives on
+void RPCWorker::runOn(QObject* context, const std::function<void(void)>& fn) {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+    QMetaObject::invokeMethod(context, fn, Qt::QueuedConnection);
+#else
+    QTimer::singleShot(0, context, fn);
+#endif
+}
+
+// Wrap the handler so it gets the parsed reply
+RawReplyHandler RPCWorker::parsing(const ReplyHandler& handler, quint64 trace) {
+    return [=] (const RPCError& error, const QByteArray& body) {
+        if (error.code != QNetworkReply::NoError) {
+            json parsed = error.body;
+            return handler(error, parsed);
+        }
+
+        json parsed;
+        {
+            Tracer::Span span("parse", "parse", trace);
+            parsed = json::parse(body.constBegin(), body.constEnd(), nullptr, false);
+        }
+        return handler(error, parsed);
+    };
+}
+
+void RPCWorker::post(const QNetworkRequest& request, const QByteArray& body, const SendOptions& options, 
+                     const ReplyHandler& handler) {
+    submit(Job{ true, request, body, parsing(handler, options.trace), nullptr, options });
+}
+
+void RPCWorker::postRaw(const QNetworkRequest& request, const QByteArray& body, const SendOptions& options, 
+                        const RawReplyHandler& handler) {
+    submit(Job{ true, request, body, handler, nullptr, options });
+}
+
+void RPCWorker::postStream(const QNetworkRequest& request, const QByteArray& body, const SendOptions& options,
+                           const ChunkHandler& onChunk, const RawReplyHandler& finished) {
+    submit(Job{ true, request, body, finished, onChunk, options });
+}
+
+// GETs go to other hosts, so they don't take any of moonroomcashd's connections
+void RPCWorker::get(const QNetworkRequest& request, const RPCHandle& handle, const ReplyHandler& handler) {
+    SendOptions options;
+    options.priority = Unbounded;
+    options.timeout  = 30 * 1000;
+    options.handle   = handle;
+
+    submit(Job{ false, request, QByteArray(), parsing(handler, options.trace), nullptr, options });
+}
+
+void RPCWorker::submit(const Job& job) {
+    jobs.push(job);
+
+    // Wake up the network thread, unless it is already going to look at the queue
+    if (!jobsScheduled.exchange(true)) {
+        runOn(netContext, [=] () { runJobs(); });
+    }
+}
+
+void RPCWorker::runJobs() {
+    jobsScheduled.store(false);
+
+    if (nam == nullptr) {
+        nam       = new QNetworkAccessManager(netContext);
+        urgentNam = new QNetworkAccessManager(netContext);
+    }
+
+    Job job;
+    while (jobs.pop(job)) {
+        waiting[job.options.priority].enqueue(job);
+    }
+
+    dispatch();
+}
+
+// Send the waiting jobs, the most urgent class first, as far as each class's bound allows
+void RPCWorker::dispatch() {
+    for (int priority = 0; priority < NumPriorities; priority++) {
+        auto& queue = waiting[priority];
+        while (!queue.isEmpty() && (priority == Unbounded || inFlight[priority] < bound(priority))) {
+            Job job = queue.dequeue();
+            if (isCancelled(job.options))
+                fail(job, cancelled());
+            else
+                start(job);
+        }
+    }
+}
+
+int RPCWorker::bound(int priority) {
+    if (limiters[priority])
+        return limiters[priority]->limit();
+
+    return maxInFlight[priority];
+}
+
+void RPCWorker::start(const Job& job) {
+    auto priority = job.options.priority;
+    inFlight[priority]++;
+
+    // The urgent classes go through their own manager, so they never wait for a connection behind
+    // a bulk read that can take minutes
+    QNetworkRequest        request = job.request;
+    QNetworkAccessManager* manager = nam;
+    if (priority == Interactive || priority == TxWatch) {
+        manager = urgentNam;
+        request.setPriority(QNetworkRequest::HighPriority);
+    } else if (priority == Export) {
+        request.setPriority(QNetworkRequest::LowPriority);
+    }
+
+    // From when it is sent to when all of the reply is in
+    auto trace = job.options.trace;
+    if (trace != 0)
+        Tracer::getInstance()->begin("network", "request", trace);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QNetworkReply* reply = job.isPost ? manager->post(request, job.body) : manager->get(request);
+    running.insert(reply, job.options.handle);
+
+    // Give up if the reply stalls. The timer restarts whenever a part of the reply arrives, so a
+    // big reply that is still coming in isn't cut off.
+    auto timedOut = std::make_shared<bool>(false);
+    if (job.options.timeout > 0) {
+        auto timer = new QTimer(reply);
+        timer->setSingleShot(true);
+        QObject::connect(timer, &QTimer::timeout, reply, [=] () {
+            *timedOut = true;
+            reply->abort();
+        });
+        QObject::connect(reply, &QNetworkReply::downloadProgress, timer, [=] () {
+            timer->start();
+        });
+        timer->start(job.options.timeout);
+    }
+
+    auto handler  = job.handler;
+    auto onChunk  = job.onChunk;
+    auto fed      = std::make_shared<bool>(false);  // If a part of the reply went to onChunk already
+    auto received = std::make_shared<qint64>(0);
+    if (onChunk) {
+        // Hand over the body as it arrives, so QNetworkReply doesn't buffer all of it
+        QObject::connect(reply, &QNetworkReply::readyRead, netContext, [=] () {
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200)
+                return;     // Error replies are read whole when they finish
+
+            *fed = true;
+            try {
+                Arena::Scope scope(arena);
+                Tracer::Span span("parse", "decode", trace);
+                auto chunk = reply->readAll();
+                *received += chunk.size();
+                onChunk(chunk);
+            } catch (const std::exception& e) {
+                qDebug() << "Couldn't decode reply:" << e.what();
+            }
+        });
+    }
+
+    QObject::connect(reply, &QNetworkReply::finished, netContext, [=] () {
+        reply->deleteLater();
+        running.remove(reply);
+        inFlight[priority]--;
+
+        if (trace != 0)
+            Tracer::getInstance()->end("network", "request", trace);
+
+        RPCError error { reply->error(), reply->errorString(), json() };
+        if (*timedOut) {
+            error = RPCError{ QNetworkReply::TimeoutError, "Timed out waiting for moonroomcashd", json() };
+        }
+
+        auto body    = reply->readAll();
+        auto limiter = limiters[priority].get();
+        *received += body.size();
+        if (isCancelled(job.options)) {
+            // Aborted by sweep(), or it was cancelled while the reply came in
+            error = cancelled();
+            body.clear();
+        } else if (isWorkQueueFull(reply, body)) {
+            if (limiter != nullptr)
+                limiter->onRejected();
+
+            if (job.retries < maxRetries) {
+                retry(job);
+                dispatch();
+                return;
+            }
+        } else if (isTransient(error.code)) {
+            // A streamed reply can't be sent again once part of it was decoded
+            if (job.options.idempotent && !*fed && job.retries < maxTransientRetries) {
+                retry(job);
+                dispatch();
+                return;
+            }
+        } else if (limiter != nullptr && error.code == QNetworkReply::NoError) {
+            limiter->onReply(elapsed.elapsed(), job.options.items);
+        }
+
+        // The slot is free, so the next waiting job can go
+        dispatch();
+
+        if (error.code != QNetworkReply::NoError) {
+            error.body = json::parse(body.constBegin(), body.constEnd(), nullptr, false);
+        } else if (onChunk) {
+            try {
+                Arena::Scope scope(arena);
+                Tracer::Span span("parse", "decode", trace);
+                onChunk(body);
+            } catch (const std::exception& e) {
+                qDebug() << "Couldn't decode reply:" << e.what();
+            }
+            body.clear();
+        }
+
+        error.retries  = job.retries;
+        error.ms       = elapsed.elapsed();
+        error.received = *received;
+        finish(handler, error, body, trace);
+    });
+}
+
+// Run the handler, and queue what it returns for the UI thread
+void RPCWorker::finish(const RawReplyHandler& handler, const RPCError& error, const QByteArray& body, quint64 trace) {
+    std::function<void(void)> result;
+    try {
+        // Whatever the handler decodes into the arena is freed once it returns
+        Arena::Scope scope(arena);
+        Tracer::Span span("parse", "handle reply", trace);
+        result = handler(error, body);
+    } catch (const std::exception& e) {
+        qDebug() << "Couldn't decode reply:" << e.what();
+    }
+
+    if (!result)
+        return;
+
+    results.push(result);
+
+    // Wake up the UI thread, unless it is already going to look at the queue
+    if (!resultsScheduled.exchange(true)) {
+        runOn(uiContext, [=] () { runResults(); });
+    }
+}
+
+// A job that is never sent
+void RPCWorker::fail(const Job& job, const RPCError& error) {
+    finish(job.handler, error, QByteArray(), job.options.trace);
+}
+
+bool RPCWorker::isCancelled(const SendOptions& options) const {
+    return stopped.load() || options.handle.isCancelled();
+}
+
+// Drop the cancelled jobs that are still waiting, and abort the cancelled requests in flight
+void RPCWorker::sweep() {
+    for (int priority = 0; priority < NumPriorities; priority++) {
+        QQueue<Job> kept;
+        for (auto& job : waiting[priority]) {
+            if (isCancelled(job.options))
+                fail(job, cancelled());
+            else
+                kept.enqueue(job);
+        }
+        waiting[priority] = kept;
+    }
+
+    // Aborting a reply finishes it right away, which takes it out of running
+    QList<QNetworkReply*> aborting;
+    for (auto it = running.constBegin(); it != running.constEnd(); it++) {
+        if (stopped.load() || it.value().isCancelled())
+            aborting.push_back(it.key());
+    }
+
+    for (auto reply : aborting) {
+        reply->abort();
+    }
+}
+
+std::function<void(void)> RPCWorker::canceller() {
+    auto stillAlive = alive;
+    return [=] () {
+        // The handle might outlive this worker, for eg. if the connection was replaced
+        if (!*stillAlive)
+            return;
+
+        runOn(netContext, [=] () { sweep(); });
+    };
+}
+
+void RPCWorker::cancelAll() {
+    stopped.store(true);
+    runOn(netContext, [=] () { sweep(); });
+}
+
+// Send the job again after a jittered backoff, ahead of the others in its class
+void RPCWorker::retry(Job job) {
+    int delay = (100 << job.retries) + randomInt(100);
+    job.retries++;
+
+    QTimer::singleShot(delay, netContext, [=] () {
+        waiting[job.options.priority].prepend(job);
+        dispatch();
+    });
+}
+
+void RPCWorker::runResults() {
+    resultsScheduled.store(false);
+
+    // A result might delete this worker (for eg. by replacing the connection), so stop if it did
+    auto stillAlive = alive;
+
+    std::function<void(void)> result;
+    while (results.pop(result)) {
+        result();
+        if (!*stillAlive)
+            return;
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef RPCWORKER_H
+#define RPCWORKER_H
+
+#include "precompiled.h"
+#include "mpscqueue.h"
+#include "arena.h"
+#include "concurrencylimiter.h"
+#include "rpchandle.h"
+#include "tracer.h"
+
+using json = nlohmann::json;
+
+// Why a request failed. This is all that is left of the reply once it reaches the UI thread.
+struct RPCError {
+    QNetworkReply::NetworkError code;
+    QString                     message;    // The network error
+    json                        body;       // The parsed reply body, discarded if it wasn't JSON
+
+    // How the request went, failed or not
+    int                         retries     = 0;    // Times it was sent again before this reply
+    qint64                      ms          = 0;    // From sending it to the end of the reply
+    qint64                      received    = 0;    // Bytes of reply body
+
+    QString errorMessage() const;           // moonroomcashd's error message if there is one, else the network error
+};
+
+/**
+ * Every request is in one of these classes, and each class has its own bound on the requests in
+ * flight (see RPCWorker), so what the user is waiting on never queues behind a big refresh.
+ * Lower is more urgent.
+ */
+enum RPCPriority {
+    Interactive,        // What the user is waiting on, like sending or making a new address
+    TxWatch,            // Following the operations of sent txs
+    Refresh,            // The periodic refreshes
+    Export,             // Bulk and long running jobs, like exporting all the keys or importing with a rescan
+    Unbounded,          // Long polls, which would hold a slot until they time out, and other hosts
+    NumPriorities
+};
+
+// How a request is sent
+struct SendOptions {
+    RPCPriority priority    = Refresh;
+    int         items       = 1;        // Calls in the body, more than 1 for a batch
+    int         timeout     = 0;        // Give up after this many ms without any of the reply, 0 to wait forever
+    bool        idempotent  = false;    // Can be sent again if the connection fails
+    RPCHandle   handle;                 // Cancels it
+    quint64     trace       = 0;        // Id of its spans in the Tracer, 0 if it isn't traced
+};
+
+// Runs on the network thread with the finished reply, and returns what should run on the UI thread
+typedef std::function<std::function<void(void)>(const RPCError& error, json& parsed)> ReplyHandler;
+
+// Same, but gets the raw reply body, for handlers that parse it themselves
+typedef std::function<std::function<void(void)>(const RPCError& error, const QByteArray& body)> RawReplyHandler;
+
+// Runs on the network thread with each piece of the reply body as it arrives
+typedef std::function<void(const QByteArray& chunk)> ChunkHandler;
+
+/**
+ * Does the network IO and the JSON parsing on its own thread, so big replies don't freeze the UI.
+ *
+ * Requests are queued from the UI thread and sent by the network thread, which owns the
+ * QNetworkAccessManager. When a reply comes in, it is parsed there and handed to the request's
+ * ReplyHandler, which can decode it further. Whatever the handler returns is queued back to
+ * the UI thread and run there, in order. Both queues are lock free.
+ *
+ * The network thread doesn't send the requests in the order they were queued. Each RPCPriority has a
+ * bound on how many of its requests are in flight, and the rest wait in that class's queue. Whenever
+ * a slot frees up, the most urgent class that is under its bound goes next. Interactive and TxWatch
+ * requests are sent through a QNetworkAccessManager of their own, so they don't wait for one of its
+ * connections behind a big refresh.
+ *
+ * The bounds of the bulk classes (Refresh, Export) adapt to how fast moonroomcashd replies, see
+ * ConcurrencyLimiter. A request that moonroomcashd turns away because its work queue is full is
+ * sent again after a backoff, instead of failing.
+ *
+ * A request fails with a TimeoutError if no part of its reply arrives within its timeout. If the
+ * request is idempotent, a timeout or a dropped connection sends it again a couple of times first.
+ *
+ * A request whose RPCHandle is cancelled is not sent, or is aborted if it is already in flight. Either
+ * way, its handler still runs with an OperationCanceledError, so the callers can clean up.
+ *
+ * The chunk and reply handlers run inside an Arena::Scope, so the DOM they decode into (see ArenaJson)
+ * comes from one arena that is reused for every reply.
+ */
+class RPCWorker {
+public:
+    RPCWorker();
+    ~RPCWorker();
+
+    void post   (const QNetworkRequest& request, const QByteArray& body, const SendOptions& options, 
+                 const ReplyHandler& handler);
+    void postRaw(const QNetworkRequest& request, const QByteArray& body, const SendOptions& options, 
+                 const RawReplyHandler& handler);
+    void get    (const QNetworkRequest& request, const RPCHandle& handle, const ReplyHandler& handler);
+
+    // The body of a successful reply is given to onChunk as it arrives, and the finished handler
+    // then gets an empty body. Error replies are still read whole and given to the finished handler.
+    void postStream(const QNetworkRequest& request, const QByteArray& body, const SendOptions& options,
+                    const ChunkHandler& onChunk, const RawReplyHandler& finished);
+
+    // What an RPCHandle runs when it is cancelled, to drop or abort its requests here
+    std::function<void(void)> canceller();
+
+    // Drop and abort every request, for when the wallet shuts down
+    void cancelAll();
+
+private:
+    struct Job {
+        bool            isPost;
+        QNetworkRequest request;
+        QByteArray      body;
+        RawReplyHandler handler;
+        ChunkHandler    onChunk;            // Only for streamed replies
+        SendOptions     options;
+        int             retries         = 0;
+    };
+
+    static RawReplyHandler parsing(const ReplyHandler& handler, quint64 trace);
+
+    void submit(const Job& job);
+    void runJobs();         // On the network thread
+    void dispatch();        // On the network thread
+    void start(const Job& job);
+    void retry(Job job);
+    void fail(const Job& job, const RPCError& error);
+    void finish(const RawReplyHandler& handler, const RPCError& error, const QByteArray& body, quint64 trace);
+    void sweep();           // On the network thread
+    bool isCancelled(const SendOptions& options) const;
+    int  bound(int priority);
+    void runResults();      // On the UI thread
+
+    static void runOn(QObject* context, const std::function<void(void)>& fn);
+
+    QThread*                netThread;
+    QObject*                netContext;                 // Lives on the network thread
+    QObject*                uiContext;                  // Lives on the UI thread
+    QNetworkAccessManager*  nam             = nullptr;  // Created on the network thread
+    QNetworkAccessManager*  urgentNam       = nullptr;  // For Interactive and TxWatch, see start()
+    Arena                   arena;                      // For decoding replies, on the network thread
+
+    // On the network thread: the jobs waiting to be sent, and the requests in flight, for each class
+    QQueue<Job>             waiting[NumPriorities];
+    int                     inFlight[NumPriorities]  = {};
+    std::unique_ptr<ConcurrencyLimiter> limiters[NumPriorities];   // For the classes whose bound adapts
+    QMap<QNetworkReply*, RPCHandle>     running;                    // The handle of each request in flight
+
+    MPSCQueue<Job>                          jobs;
+    MPSCQueue<std::function<void(void)>>    results;
+
+    std::atomic<bool>       jobsScheduled   { false };
+    std::atomic<bool>       resultsScheduled{ false };
+    std::atomic<bool>       stopped         { false };  // Everything was cancelled
+
+    std::shared_ptr<bool>   alive;          // Cleared when this is deleted, in case a result deletes it
+};
+
+#endif // RPCWORKER_H
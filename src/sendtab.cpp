@@ -580,8 +580,7 @@ void MainWindow::sendButton() {
         std::cout << std::setw(2) << params << std::endl;
 
         // And send the Tx
-        rpc->sendZTransaction(params, [=](const json& reply) {
-            QString opid = QString::fromStdString(reply.get<json::string_t>());
+        rpc->sendZTransaction(params, [=](QString opid) {
             ui->statusBar->showMessage("Computing Tx: " % opid);
 
             // And then start monitoring the transaction
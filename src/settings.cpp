@@ -115,6 +115,80 @@ void Settings::setAllowCustomFees(bool allow) {
     QSettings().setValue("options/customfees", allow);
 }
 
+int Settings::getRPCBatchSize() {
+    // Load from the QT Settings. 
+    int size = QSettings().value("connection/batchsize", defaultRPCBatchSize).toInt();
+    if (size <= 0)
+        return defaultRPCBatchSize;
+
+    return size;
+}
+
+void Settings::setRPCBatchSize(int size) {
+    QSettings().setValue("connection/batchsize", size);
+}
+
+// Other moonroomcashd nodes the reads are spread over, each as user:password@host:port. See NodePool.
+QStringList Settings::getRPCReplicas() {
+    return QSettings().value("connection/replicas").toStringList();
+}
+
+void Settings::setRPCReplicas(const QStringList& replicas) {
+    QSettings().setValue("connection/replicas", replicas);
+}
+
+// The local port the Prometheus metrics are served on. 0, the default, doesn't serve them. See MetricsServer.
+int Settings::getMetricsPort() {
+    int port = QSettings().value("options/metricsport", 0).toInt();
+    if (port < 0 || port > 65535)
+        return 0;
+
+    return port;
+}
+
+void Settings::setMetricsPort(int port) {
+    QSettings().setValue("options/metricsport", port);
+}
+
+int Settings::getReorgDepth() {
+    // Load from the QT Settings. 
+    int depth = QSettings().value("options/reorgdepth", defaultReorgDepth).toInt();
+    if (depth <= 0)
+        return defaultReorgDepth;
+
+    return depth;
+}
+
+void Settings::setReorgDepth(int depth) {
+    QSettings().setValue("options/reorgdepth", depth);
+}
+
+int Settings::getZRecvShardSize() {
+    // Load from the QT Settings. 
+    int size = QSettings().value("options/zrecvshardsize", defaultZShardSize).toInt();
+    if (size <= 0)
+        return defaultZShardSize;
+
+    return size;
+}
+
+void Settings::setZRecvShardSize(int size) {
+    QSettings().setValue("options/zrecvshardsize", size);
+}
+
+int Settings::getUTXOReconcileInterval() {
+    // Load from the QT Settings. 
+    int blocks = QSettings().value("options/utxoreconcile", defaultReconcileGap).toInt();
+    if (blocks <= 0)
+        return defaultReconcileGap;
+
+    return blocks;
+}
+
+void Settings::setUTXOReconcileInterval(int blocks) {
+    QSettings().setValue("options/utxoreconcile", blocks);
+}
+
 bool Settings::getSaveZtxs() {
     // Load from the QT Settings. 
     return QSettings().value("options/savesenttx", true).toBool();
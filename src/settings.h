@@ -45,6 +45,24 @@ public:
 
     bool    getAllowCustomFees();
     void    setAllowCustomFees(bool allow);
+
+    int     getRPCBatchSize();
+    void    setRPCBatchSize(int size);
+
+    QStringList getRPCReplicas();
+    void    setRPCReplicas(const QStringList& replicas);
+
+    int     getMetricsPort();
+    void    setMetricsPort(int port);
+
+    int     getReorgDepth();
+    void    setReorgDepth(int depth);
+
+    int     getZRecvShardSize();
+    void    setZRecvShardSize(int size);
+
+    int     getUTXOReconcileInterval();
+    void    setUTXOReconcileInterval(int blocks);
             
     bool    isSaplingActive();
 
@@ -83,6 +101,12 @@ public:
     static const int     updateSpeed         = 20 * 1000;        // 20 sec
     static const int     quickUpdateSpeed    = 5  * 1000;        // 5 sec
     static const int     priceRefreshSpeed   = 60 * 60 * 1000;   // 1 hr
+    static const int     blockPollSpeed      = 2  * 1000;        // 2 sec
+
+    static const int     defaultRPCBatchSize = 100;              // Payloads per JSON-RPC batch
+    static const int     defaultReorgDepth   = 100;              // Blocks after which a tx can't be reorged
+    static const int     defaultZShardSize   = 100;              // z-Addresses scanned for received txs per tick
+    static const int     defaultReconcileGap = 100;              // Blocks between full unspent reconciliations
 
 private:
     // This class can only be accessed through Settings::getInstance()
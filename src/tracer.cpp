@@ -0,0 +1,158 @@
+#include "tracer.h"
+
+Tracer*             Tracer::instance = nullptr;
+std::atomic<bool>   Tracer::enabled { false };
+
+Tracer* Tracer::getInstance() {
+    if (instance == nullptr)
+        instance = new Tracer();
+
+    return instance;
+}
+
+bool Tracer::start(const QString& fileName) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (file != nullptr)
+        return true;
+
+    file = new QFile(fileName);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "Couldn't open trace file" << fileName << ":" << file->errorString();
+        delete file;
+        file = nullptr;
+        return false;
+    }
+
+    // The JSON Array Format, which doesn't need the closing ] if the wallet is killed
+    file->write("[\n");
+    clock.start();
+    enabled.store(true);
+
+    qDebug() << "Writing trace to" << fileName;
+    return true;
+}
+
+void Tracer::finish() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (file == nullptr)
+        return;
+
+    enabled.store(false);
+
+    file->write("\n]\n");
+    file->close();
+    delete file;
+    file = nullptr;
+}
+
+qint64 Tracer::now() {
+    return clock.nsecsElapsed() / 1000;
+}
+
+// Called with the lock held
+void Tracer::append(const json& event) {
+    if (!first)
+        file->write(",\n");
+    first = false;
+
+    file->write(QByteArray::fromStdString(event.dump()));
+}
+
+// Called with the lock held
+int Tracer::threadIndex() {
+    auto thread = QThread::currentThread();
+    auto it = threads.find(thread);
+    if (it != threads.end())
+        return it.value();
+
+    int tid = threads.size() + 1;
+    threads[thread] = tid;
+
+    // Name the thread in the viewer
+    auto name = thread->objectName();
+    if (name.isEmpty() && thread == qApp->thread())
+        name = "UI";
+    else if (name.isEmpty())
+        name = "Thread " % QString::number(tid);
+
+    json meta = {
+        {"ph", "M"},
+        {"name", "thread_name"},
+        {"pid", 1},
+        {"tid", tid},
+        {"args", {{"name", name.toStdString()}}}
+    };
+    append(meta);
+
+    return tid;
+}
+
+void Tracer::write(char phase, const char* category, const QString& name, quint64 id, qint64 ts, qint64 dur) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (file == nullptr)
+        return;
+
+    json event = {
+        {"ph", std::string(1, phase)},
+        {"cat", category},
+        {"name", name.toStdString()},
+        {"pid", 1},
+        {"tid", threadIndex()},
+        {"ts", ts}
+    };
+
+    if (dur >= 0)
+        event["dur"] = dur;
+
+    // Async events are matched up by their category, name and id
+    if (phase == 'b' || phase == 'e')
+        event["id"] = QString::number(id, 16).toStdString();
+
+    json args = json::object();
+    auto refresh = cycle.load();
+    if (refresh != 0)
+        args["refresh"] = refresh;
+    if (id != 0)
+        args["id"] = id;
+    if (!args.empty())
+        event["args"] = args;
+
+    append(event);
+}
+
+void Tracer::begin(const char* category, const QString& name, quint64 id) {
+    if (!isEnabled())
+        return;
+
+    write('b', category, name, id, now());
+}
+
+void Tracer::end(const char* category, const QString& name, quint64 id) {
+    if (!isEnabled())
+        return;
+
+    write('e', category, name, id, now());
+}
+
+void Tracer::repaint(QWidget* widget, const QString& name) {
+    if (!isEnabled() || widget == nullptr || !widget->isVisible())
+        return;
+
+    Span span("paint", name);
+    widget->repaint();
+}
+
+Tracer::Span::Span(const char* category, const QString& name, quint64 id) :
+    category(category), name(name), id(id) {
+    if (Tracer::isEnabled())
+        start = Tracer::getInstance()->now();
+}
+
+Tracer::Span::~Span() {
+    if (start < 0 || !Tracer::isEnabled())
+        return;
+
+    auto tracer = Tracer::getInstance();
+    auto end    = tracer->now();
+    tracer->write('X', category, name, id, start, end - start);
+}
@@ -0,0 +1,74 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "precompiled.h"
+
+#include <atomic>
+#include <mutex>
+
+using json = nlohmann::json;
+
+/**
+ * Records what the wallet spends its time on as trace events, in the Chrome trace event JSON format
+ * that chrome://tracing and Perfetto open. Only on when the wallet is started with --trace <file>.
+ *
+ * Spans that start and end in the same function are recorded with a Span. Spans that are tied
+ * together by callbacks, like an RPC from when it is sent to when its reply is handled, are recorded
+ * with begin() and end() and an id that is the same for both. Every event also gets the id of the
+ * refresh cycle it happened in (see setCycle), so all the work of one refresh can be picked out.
+ *
+ * The events are written to the file as they happen, so the trace is there even if the wallet
+ * doesn't exit cleanly. Can be used from any thread.
+ */
+class Tracer {
+public:
+    static Tracer*  getInstance();
+    static bool     isEnabled() { return enabled.load(); }
+
+    bool    start(const QString& fileName);
+    void    finish();
+
+    quint64 newId() { return ++lastId; }
+    void    setCycle(quint64 id) { cycle.store(id); }
+
+    void    begin(const char* category, const QString& name, quint64 id);
+    void    end  (const char* category, const QString& name, quint64 id);
+
+    // Paint the widget right away, to see how long it takes. Widgets are normally painted later, when the event loop gets to it.
+    void    repaint(QWidget* widget, const QString& name);
+
+    // Records the time from its construction to its destruction
+    class Span {
+    public:
+        Span(const char* category, const QString& name, quint64 id = 0);
+        ~Span();
+
+    private:
+        const char* category;
+        QString     name;
+        quint64     id;
+        qint64      start = -1;
+    };
+
+private:
+    Tracer() = default;
+
+    qint64  now();      // In microseconds since the trace started
+    void    write(char phase, const char* category, const QString& name, quint64 id, qint64 ts, qint64 dur = -1);
+    int     threadIndex();
+    void    append(const json& event);
+
+    static Tracer*              instance;
+    static std::atomic<bool>    enabled;
+
+    std::mutex                  lock;
+    QFile*                      file    = nullptr;
+    QElapsedTimer               clock;
+    QMap<QThread*, int>         threads;
+    bool                        first   = true;
+
+    std::atomic<quint64>        lastId  { 0 };
+    std::atomic<quint64>        cycle   { 0 };
+};
+
+#endif // TRACER_H
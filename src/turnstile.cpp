@@ -88,12 +88,7 @@ void Turnstile::planMigration(QString zaddr, QString destAddr, int numsplits, in
     // Then, generate an intermediate t-address for each part using getBatchRPC
     rpc->getConnection()->doBatchRPC<double>(splits,
         [=] (double /*unused*/) {
-            json payload = {
-                {"jsonrpc", "1.0"},
-                {"id", "someid"},
-                {"method", "getnewaddress"},
-            };
-            return payload;
+            return RPCMethods::payload<RPCMethods::GetNewAddress>();
         },
         [=] (QMap<double, json>* newAddrs) {
             // Get block numbers
@@ -129,6 +124,9 @@ void Turnstile::planMigration(QString zaddr, QString destAddr, int numsplits, in
 
             writeMigrationPlan(migItems);
             rpc->refresh(true);    // Force refresh, to start the migration immediately
+        },
+        [=] (const RPCError& error) {
+            rpc->getConnection()->showTxError(error.errorMessage());
         }
     );
 }
@@ -354,8 +352,7 @@ void Turnstile::doSendTx(Tx tx, std::function<void(void)> cb) {
     json params = json::array();
     rpc->fillTxJsonParams(params, tx);
     std::cout << std::setw(2) << params << std::endl;
-    rpc->sendZTransaction(params, [=] (const json& reply) {
-        QString opid = QString::fromStdString(reply.get<json::string_t>());
+    rpc->sendZTransaction(params, [=] (QString opid) {
         //qDebug() << opid;
         mainwindow->ui->statusBar->showMessage("Computing Tx: " % opid);
 
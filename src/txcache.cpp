@@ -0,0 +1,234 @@
+#include "txcache.h"
+#include "settings.h"
+
+// Fold the journal into the cache file once it has this many entries, and more than half as many as the cache
+static const int minCompactEntries = 1000;
+
+TxCache::~TxCache() {
+    save();
+}
+
+/// Get the location of the app data file to be written. 
+QString TxCache::writeableFile(const QString& filename) {
+    auto dir = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    if (!dir.exists())
+        QDir().mkpath(dir.absolutePath());
+
+    if (Settings::getInstance()->isTestnet()) {
+        return dir.filePath("testnet-" % filename);
+    } else {
+        return dir.filePath(filename);
+    }
+}
+
+// Data stream write/read methods for cached txs
+QDataStream &operator<<(QDataStream& ds, const CachedTx& tx) {
+    return ds << QString("v1") << tx.txid << tx.height << QByteArray::fromStdString(tx.details.dump());
+}
+
+QDataStream &operator>>(QDataStream& ds, CachedTx& tx) {
+    QString    version;
+    QByteArray details;
+    ds >> version >> tx.txid >> tx.height >> details;
+
+    tx.details = json::parse(details, nullptr, false);
+    return ds;
+}
+
+// The file is only read once we know which network we're on, so it is loaded lazily
+void TxCache::loadIfNeeded() {
+    bool isTestnet = Settings::getInstance()->isTestnet();
+    if (loaded && loadedTestnet == isTestnet)
+        return;
+
+    txs.clear();
+    changed.clear();
+    loaded         = true;
+    loadedTestnet  = isTestnet;
+    journalEntries = 0;
+
+    QFile file(writeableFile("txcache.dat"));
+    if (file.exists()) {
+        file.open(QIODevice::ReadOnly);
+        QDataStream in(&file);    // read the data serialized from the file
+
+        QList<CachedTx> items;
+        in >> items;
+        file.close();
+
+        for (auto& tx : items) {
+            if (!tx.details.is_discarded())
+                txs[tx.txid] = tx;
+        }
+    }
+
+    // Then the changes since, in the order they were made. A write that was cut short leaves a
+    // partial entry at the end. It is dropped, and the journal started over so nothing is appended after it.
+    QFile journal(writeableFile("txcache.journal"));
+    if (journal.exists()) {
+        journal.open(QIODevice::ReadOnly);
+        QDataStream in(&journal);
+
+        bool truncated = false;
+        while (!in.atEnd()) {
+            bool     removed;
+            CachedTx tx;
+            in >> removed;
+            if (removed)
+                in >> tx.txid;
+            else
+                in >> tx;
+
+            if (in.status() != QDataStream::Ok) {
+                truncated = true;
+                break;
+            }
+
+            if (removed)
+                txs.remove(tx.txid);
+            else if (!tx.details.is_discarded())
+                txs[tx.txid] = tx;
+            journalEntries++;
+        }
+        journal.close();
+
+        if (truncated)
+            compact();
+    }
+}
+
+// Append the txs that changed since the last save to the journal
+void TxCache::save() {
+    if (changed.isEmpty())
+        return;
+
+    if (journalEntries + changed.size() >= minCompactEntries && journalEntries + changed.size() > txs.size() / 2) {
+        compact();
+        return;
+    }
+
+    QFile journal(writeableFile("txcache.journal"));
+    journal.open(QIODevice::WriteOnly | QIODevice::Append);
+    QDataStream out(&journal);
+    for (auto& txid : changed) {
+        auto it = txs.constFind(txid);
+        if (it == txs.constEnd())
+            out << true << txid;
+        else
+            out << false << *it;
+    }
+    journal.close();
+
+    journalEntries += changed.size();
+    changed.clear();
+}
+
+// Write the whole cache to the cache file, and start a new journal
+void TxCache::compact() {
+    QFile file(writeableFile("txcache.dat"));
+    file.open(QIODevice::ReadWrite | QIODevice::Truncate);
+    QDataStream out(&file);   // we will serialize the data into the file
+    out << txs.values();
+    file.close();
+
+    QFile::remove(writeableFile("txcache.journal"));
+    journalEntries = 0;
+    changed.clear();
+}
+
+bool TxCache::isMined(const QString& txid) {
+    return height(txid) > 0;
+}
+
+int TxCache::height(const QString& txid) {
+    loadIfNeeded();
+
+    auto it = txs.constFind(txid);
+    if (it == txs.constEnd())
+        return 0;
+
+    return it->height;
+}
+
+QString TxCache::blockhash(const QString& txid) {
+    loadIfNeeded();
+
+    auto it = txs.constFind(txid);
+    if (it == txs.constEnd())
+        return QString();
+
+    auto hash = it->details.find("blockhash");
+    if (hash == it->details.end() || !hash->is_string())
+        return QString();
+
+    return QString::fromStdString(hash->get<json::string_t>());
+}
+
+/**
+ * A tx is final once it is buried deeper than the reorg depth. It will never change, so 
+ * there's no need to ask moonroomcashd about it again.
+ */
+bool TxCache::isFinal(const QString& txid, int curBlock) {
+    loadIfNeeded();
+
+    auto it = txs.constFind(txid);
+    if (it == txs.constEnd() || it->height <= 0)
+        return false;
+
+    return curBlock - it->height + 1 >= Settings::getInstance()->getReorgDepth();
+}
+
+/**
+ * Get the cached gettransaction reply, with the confirmations calculated from the 
+ * current block
+ */
+json TxCache::get(const QString& txid, int curBlock) {
+    loadIfNeeded();
+
+    auto it = txs.constFind(txid);
+    if (it == txs.constEnd())
+        return json::object();
+
+    json reply = it->details;
+    reply["confirmations"] = (it->height > 0 && curBlock >= it->height) ? curBlock - it->height + 1 : 0;
+    return reply;
+}
+
+// Forget a tx, for eg. because the block it was mined in was reorged out
+void TxCache::remove(const QString& txid) {
+    loadIfNeeded();
+
+    if (txs.remove(txid) > 0)
+        changed.push_back(txid);
+}
+
+void TxCache::put(const QString& txid, const json& reply, int curBlock) {
+    loadIfNeeded();
+
+    if (!reply.is_object())
+        return;
+
+    auto found = reply.find("confirmations");
+    if (found == reply.end() || !found->is_number_integer())
+        return;
+
+    // Conflicted txs have negative confirmations. They are not worth remembering.
+    auto confirmations = found->get<json::number_integer_t>();
+    if (confirmations < 0)
+        return;
+
+    int height = confirmations > 0 ? curBlock - (int)confirmations + 1 : 0;
+
+    // Only the immutable fields are kept
+    json details = reply;
+    details.erase("confirmations");
+    details.erase("hex");
+    details.erase("walletconflicts");
+
+    auto it = txs.find(txid);
+    if (it != txs.end() && it->height == height)
+        return;
+
+    txs[txid] = CachedTx{ txid, height, details };
+    changed.push_back(txid);
+}
@@ -0,0 +1,53 @@
+#ifndef TXCACHE_H
+#define TXCACHE_H
+
+#include "precompiled.h"
+
+using json = nlohmann::json;
+
+struct CachedTx {
+    QString     txid;
+    int         height;         // Block the tx was mined in
+    json        details;        // The immutable fields of the gettransaction reply
+};
+
+/**
+ * A txid -> gettransaction cache, persisted to disk. Transactions that are buried deeper than the 
+ * reorg depth can't change anymore, so they are served from the cache and never fetched again. 
+ *
+ * The cache of a big wallet is tens of MB, so save() doesn't write all of it. The txs that were
+ * added or removed since the last save are appended to a journal next to the cache file, which is
+ * replayed when the cache is loaded. Once the journal gets long, it is folded back into the cache file.
+ */
+class TxCache {
+public:
+    TxCache() = default;
+    ~TxCache();
+
+    bool    isMined(const QString& txid);
+    bool    isFinal(const QString& txid, int curBlock);
+    int     height (const QString& txid);
+    QString blockhash(const QString& txid);
+
+    json    get    (const QString& txid, int curBlock);
+    void    put    (const QString& txid, const json& reply, int curBlock);
+    void    remove (const QString& txid);
+
+    void    save();
+
+    int     size() const { return txs.size(); }     // Txs loaded
+
+private:
+    QString writeableFile(const QString& filename);
+    void    loadIfNeeded();
+    void    compact();
+
+    QMap<QString, CachedTx> txs;
+    QList<QString>          changed;            // Txids added or removed since the last save
+
+    bool    loaded          = false;
+    bool    loadedTestnet   = false;
+    int     journalEntries  = 0;                // In the journal file
+};
+
+#endif // TXCACHE_H
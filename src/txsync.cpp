@@ -0,0 +1,248 @@
+#include "txsync.h"
+
+using json = nlohmann::json;
+
+TxSync::TxSync(RPC* _rpc) {
+    this->rpc = _rpc;
+}
+
+/**
+ * Forget everything that was synced, so the next sync downloads the full history again. A sync
+ * that is still running is abandoned, its replies are from the old connection.
+ */
+void TxSync::reset() {
+    txs.clear();
+    checkpoints.clear();
+
+    generation++;
+    syncing = false;
+}
+
+/**
+ * Bring the tx history up to date, and call the callback with all the transparent txs. 
+ */
+void TxSync::sync(const std::function<void(QList<TransactionItem>)>& cb) {
+    auto conn = rpc->getConnection();
+    if (conn == nullptr || syncing)
+        return;
+
+    syncing = true;
+    int gen = generation;
+
+    if (checkpoints.isEmpty()) {
+        // Nothing synced yet, so get the whole history
+        syncSince(QString(), cb);
+        return;
+    }
+
+    auto last = checkpoints.last();
+
+    // Check that the last synced block is still in the main chain, and get the new txs since 
+    // then in the same batch. The tip is read before listsinceblock, so the checkpoint it
+    // becomes is never past the txs that were merged, and the heights of the txs are worked
+    // out from it instead of from the block number when the batch was sent.
+    QList<json> payloads;
+    payloads.push_back(RPCMethods::payload<RPCMethods::GetBlockHash>({ last.first }));
+    payloads.push_back(RPCMethods::payload<RPCMethods::GetBlockchainInfo>());
+    payloads.push_back(RPCMethods::payload<RPCMethods::ListSinceBlock>({ last.second }));
+
+    // The txs are decoded on the network thread as they arrive
+    conn->doRPCArrayRecords<QList<BatchReply>>(payloads, [=] (QList<BatchReply>& replies) {
+        return std::move(replies);
+    }, [=] (QList<BatchReply> replies) {
+        if (gen != generation)
+            return;
+
+        BatchReply& hash  = replies[0];
+        BatchReply& tip   = replies[1];
+        BatchReply& delta = replies[2];
+
+        QString hashResult;
+        bool sameChain = hash.error.isEmpty() && 
+                         RPCMethods::GetBlockHash::decode(json::parse(hash.result.constBegin(), hash.result.constEnd(), nullptr, false), hashResult) &&
+                         hashResult == last.second;
+        if (!sameChain) {
+            // The last synced block was reorged out, so find where the chain forked
+            rollback(cb);
+            return;
+        }
+
+        RPCMethods::GetBlockchainInfo::Result chain;
+        if (!delta.error.isEmpty() || !decodeTip(tip, chain)) {
+            syncing = false;
+            return;
+        }
+
+        merge(delta.transactions, chain.blocks);
+        addCheckpoint(chain);
+
+        syncing = false;
+        cb(txs.values());
+    }, [=] (const RPCError&) {
+        if (gen != generation)
+            return;
+
+        syncing = false;
+    });
+}
+
+/**
+ * Get all the txs after the given block (or all txs, if there's no block) and merge them in. 
+ */
+void TxSync::syncSince(const QString& blockhash, const std::function<void(QList<TransactionItem>)>& cb) {
+    int gen = generation;
+
+    // The tip goes first, for the checkpoint. See sync().
+    QList<json> payloads;
+    payloads.push_back(RPCMethods::payload<RPCMethods::GetBlockchainInfo>());
+    payloads.push_back(RPCMethods::payload<RPCMethods::ListSinceBlock>({ blockhash }));
+
+    // Sent as a batch, so the history is decoded as it arrives instead of parsed whole
+    rpc->getConnection()->doRPCArrayRecords<QList<BatchReply>>(payloads, [=] (QList<BatchReply>& replies) {
+        return std::move(replies);
+    }, [=] (QList<BatchReply> replies) {
+        if (gen != generation)
+            return;
+
+        BatchReply& reply = replies[1];
+        if (!reply.error.isEmpty()) {
+            qDebug() << reply.error;
+            syncing = false;
+            return;
+        }
+
+        RPCMethods::GetBlockchainInfo::Result chain;
+        if (!decodeTip(replies[0], chain)) {
+            qDebug() << "Unexpected reply to getblockchaininfo" << replies[0].error;
+            syncing = false;
+            return;
+        }
+
+        merge(reply.transactions, chain.blocks);
+        addCheckpoint(chain);
+
+        syncing = false;
+        cb(txs.values());
+    }, [=] (const RPCError& error) {
+        if (gen != generation)
+            return;
+
+        qDebug() << error.message << QString::fromStdString(error.body.dump());
+        syncing = false;
+    });
+}
+
+// The tip from the getblockchaininfo reply that went out with listsinceblock
+bool TxSync::decodeTip(const BatchReply& tip, RPCMethods::GetBlockchainInfo::Result& chain) {
+    return tip.error.isEmpty() &&
+           RPCMethods::GetBlockchainInfo::decode(json::parse(tip.result.constBegin(), tip.result.constEnd(), nullptr, false), chain) &&
+           !chain.bestBlockHash.isEmpty();
+}
+
+/**
+ * Remember the tip as the next block to sync from. Its height and hash come from the same reply,
+ * so they always name the same block.
+ */
+void TxSync::addCheckpoint(const RPCMethods::GetBlockchainInfo::Result& chain) {
+    if (!checkpoints.isEmpty() && checkpoints.last().first >= chain.blocks)
+        return;
+
+    checkpoints.push_back(QPair<int, QString>(chain.blocks, chain.bestBlockHash));
+    while (checkpoints.size() > maxCheckpoints)
+        checkpoints.removeFirst();
+}
+
+/**
+ * Find the newest checkpoint that is still in the main chain, drop all txs after it and sync 
+ * again from there. If none of them are, start over with a full sync. 
+ */
+void TxSync::rollback(const std::function<void(QList<TransactionItem>)>& cb) {
+    auto candidates = checkpoints;
+    int  gen        = generation;
+
+    QList<json> payloads;
+    for (auto checkpoint : candidates) {
+        payloads.push_back(RPCMethods::payload<RPCMethods::GetBlockHash>({ checkpoint.first }));
+    }
+
+    rpc->getConnection()->doRPCArray(payloads, [=] (QList<json> replies) {
+        if (gen != generation)
+            return;
+
+        int fork = -1;
+        for (int i = candidates.size() - 1; i >= 0; i--) {
+            QString hash;
+            if (RPCMethods::result<RPCMethods::GetBlockHash>(replies[i], hash) && hash == candidates[i].second) {
+                fork = i;
+                break;
+            }
+        }
+
+        if (fork < 0) {
+            qDebug() << "Reorg deeper than all checkpoints, resyncing tx history";
+            txs.clear();
+            checkpoints.clear();
+            syncSince(QString(), cb);
+            return;
+        }
+
+        auto forkPoint = candidates[fork];
+        checkpoints = candidates.mid(0, fork + 1);
+
+        // Unmined txs are always sent again, so they are dropped along with the rolled back ones
+        for (auto it = txs.begin(); it != txs.end(); ) {
+            if (it->height == 0 || it->height > forkPoint.first) {
+                it = txs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        qDebug() << "Rolled back tx history to block" << forkPoint.first;
+        syncSince(forkPoint.second, cb);
+    }, [=] (const RPCError&) {
+        if (gen != generation)
+            return;
+
+        syncing = false;
+    });
+}
+
+QString TxSync::txKey(const TxRecord& entry) {
+    return entry.txid % ":" % entry.category % ":" % entry.address % ":" % QString::number(entry.vout < 0 ? 0 : entry.vout);
+}
+
+/**
+ * Merge the txs from listsinceblock into the history. curBlock is the tip the confirmations count from.
+ */
+void TxSync::merge(const QList<TxRecord>& transactions, int curBlock) {
+    // listsinceblock always returns all the unmined txs, so remove the ones we had. The ones that
+    // are still unmined will be added back below, and the mined ones will come back with their block.
+    for (auto it = txs.begin(); it != txs.end(); ) {
+        if (it->height == 0) {
+            it = txs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto& it : transactions) {  
+        if (it.confirmations < 0) {
+            // Conflicted tx, it will never be mined
+            continue;
+        }
+
+        TransactionItem tx{
+            it.category,
+            it.time,
+            it.address,
+            it.txid,
+            it.amount + it.fee,
+            (unsigned long)it.confirmations,
+            "", "",
+            it.confirmations > 0 ? curBlock - (int)it.confirmations + 1 : 0,
+            it.blockhash };
+
+        txs[txKey(it)] = tx;
+    }
+}
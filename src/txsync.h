@@ -0,0 +1,45 @@
+#ifndef TXSYNC_H
+#define TXSYNC_H
+
+#include "precompiled.h"
+#include "rpc.h"
+#include "fastjson.h"
+
+using json = nlohmann::json;
+
+/**
+ * Keeps the full transparent tx history of the wallet in sync with moonroomcashd. Instead of 
+ * downloading the whole history every block, it remembers the last block it synced to and only
+ * asks for the txs since then with listsinceblock. If that block was reorged out, the txs after 
+ * the fork point are rolled back and synced again.
+ */
+class TxSync {
+public:
+    TxSync(RPC* _rpc);
+
+    void    sync(const std::function<void(QList<TransactionItem>)>& cb);
+    void    reset();
+
+private:
+    void    syncSince(const QString& blockhash, const std::function<void(QList<TransactionItem>)>& cb);
+    void    rollback(const std::function<void(QList<TransactionItem>)>& cb);
+    void    merge(const QList<TxRecord>& transactions, int curBlock);
+    void    addCheckpoint(const RPCMethods::GetBlockchainInfo::Result& chain);
+
+    static bool     decodeTip(const BatchReply& tip, RPCMethods::GetBlockchainInfo::Result& chain);
+    static QString  txKey(const TxRecord& entry);
+
+    RPC*    rpc;
+
+    QMap<QString, TransactionItem>  txs;            // txid:category:address:vout -> tx
+
+    // The last few tips that were synced to, as (height, blockhash), newest last. 
+    QList<QPair<int, QString>>      checkpoints;
+
+    bool    syncing     = false;
+    int     generation  = 0;        // Bumped by reset(), so replies to an abandoned sync are dropped
+
+    static const int maxCheckpoints = 10;
+};
+
+#endif // TXSYNC_H
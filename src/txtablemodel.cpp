@@ -39,6 +39,41 @@ void TxTableModel::addTData(const QList<TransactionItem>& data) {
     updateAllData();
 }
 
+/**
+ * Recalculate the confirmations of all the mined txs from the block they were mined in. 
+ */
+void TxTableModel::updateConfirmations(int curBlock) {
+    auto fnUpdate = [=] (QList<TransactionItem>* list) {
+        if (list == nullptr)
+            return;
+
+        for (auto& tx : *list) {
+            if (tx.height > 0)
+                tx.confirmations = curBlock >= tx.height ? curBlock - tx.height + 1 : 0;
+        }
+    };
+
+    fnUpdate(tTrans);
+    fnUpdate(zsTrans);
+    fnUpdate(zrTrans);
+    fnUpdate(modeldata);
+
+    if (modeldata != nullptr && !modeldata->isEmpty())
+        dataChanged(index(0, 0), index(modeldata->size()-1, columnCount(index(0,0))-1));
+}
+
+QSet<QString> TxTableModel::getUnconfirmedTxids() {
+    QSet<QString> txids;
+    if (modeldata == nullptr)
+        return txids;
+
+    for (auto& tx : *modeldata) {
+        if (tx.height == 0 && !tx.txid.isEmpty())
+            txids.insert(tx.txid);
+    }
+    return txids;
+}
+
 void TxTableModel::updateAllData() {    
     auto newmodeldata = new QList<TransactionItem>();
 
@@ -15,6 +15,10 @@ public:
     void addZSentData(const QList<TransactionItem>& data);
     void addZRecvData(const QList<TransactionItem>& data);     
 
+    void updateConfirmations(int curBlock);
+
+    QSet<QString> getUnconfirmedTxids();
+
     QString  getTxId(int row);
     QString  getMemo(int row);
     QString  getAddr(int row);
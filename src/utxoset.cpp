@@ -0,0 +1,350 @@
+#include "utxoset.h"
+#include "settings.h"
+
+using json = nlohmann::json;
+
+UTXOSet::UTXOSet(RPC* _rpc) {
+    this->rpc = _rpc;
+}
+
+/**
+ * Forget all the outputs, so the next update does a full reconciliation. An update that is still
+ * running is abandoned, its replies are from the old connection.
+ */
+void UTXOSet::reset() {
+    entries.clear();
+    dirty.clear();
+    lastUpdateBlock = 0;
+    lastFullBlock   = 0;
+
+    generation++;
+    updating = false;
+}
+
+// Re-read all the outputs of this address on the next update, for eg. because it spent something
+void UTXOSet::markDirty(const QString& addr) {
+    if (!addr.isEmpty())
+        dirty.insert(addr);
+}
+
+/**
+ * Bring the set up to date with the current block, and call the callback with the
+ * z_gettotalbalance reply that it was checked against.
+ */
+void UTXOSet::update(const std::function<void(RPCMethods::ZGetTotalBalance::Result)>& cb) {
+    auto conn = rpc->getConnection();
+    if (conn == nullptr || updating)
+        return;
+
+    updating = true;
+
+    int gen      = generation;
+    int curBlock = Settings::getInstance()->getBlockNumber();
+    int window   = curBlock - lastUpdateBlock + 1;     // maxconf that covers everything since the last update
+
+    bool full = lastFullBlock == 0 || window < 1 ||
+                window > Settings::getInstance()->getReorgDepth() ||
+                curBlock - lastFullBlock >= Settings::getInstance()->getUTXOReconcileInterval();
+
+    // Unconfirmed outputs might have been mined or dropped since, so always re-read their addresses
+    QSet<QString> tDirty, zDirty;
+    for (auto& entry : entries) {
+        if (entry.height == 0)
+            dirty.insert(entry.out.address);
+    }
+    for (auto addr : dirty) {
+        if (Settings::isZAddress(addr))
+            zDirty.insert(addr);
+        else
+            tDirty.insert(addr);
+    }
+    dirty.clear();
+
+    // The dirty addresses changed in ways only the primary has seen, see NodePool
+    if (!tDirty.isEmpty() || !zDirty.isEmpty())
+        conn->pinReadsToPrimary();
+
+    // Each pool is read with a request of its own, so moonroomcashd lists them at the same time instead
+    // of one after the other, as it would the calls of one batch. Each request starts with the tip, so
+    // the heights are worked out from the block its outputs were listed at and not from curBlock, which
+    // could be a few blocks old by the time a big listunspent returns. The balance goes along with the
+    // transparent outputs. Each unspent payload comes with how to apply its reply to the set.
+    QList<json> tPayloads, zPayloads;
+    QList<std::function<void(const UTXODelta&)>> tAppliers, zAppliers;
+
+    tPayloads.push_back(RPCMethods::payload<RPCMethods::GetBlockchainInfo>());
+    tPayloads.push_back(RPCMethods::payload<RPCMethods::ZGetTotalBalance>({ 0 }));    // Get Unconfirmed balance as well.
+    zPayloads.push_back(RPCMethods::payload<RPCMethods::GetBlockchainInfo>());
+
+    if (full) {
+        // Get UTXOs with 0 confirmations as well.
+        tPayloads.push_back(RPCMethods::payload<RPCMethods::ListUnspent>({ 0, -1, {} }));
+        tAppliers.push_back([=] (const UTXODelta& delta) { replaceAll(delta, false); });
+
+        zPayloads.push_back(RPCMethods::payload<RPCMethods::ZListUnspent>({ 0, -1, {} }));
+        zAppliers.push_back([=] (const UTXODelta& delta) { replaceAll(delta, true); });
+    } else {
+        if (!tDirty.isEmpty()) {
+            tPayloads.push_back(RPCMethods::payload<RPCMethods::ListUnspent>({ 0, -1, tDirty.toList() }));
+            tAppliers.push_back([=] (const UTXODelta& delta) { replaceAddresses(delta, tDirty); });
+        }
+        if (!zDirty.isEmpty()) {
+            zPayloads.push_back(RPCMethods::payload<RPCMethods::ZListUnspent>({ 0, -1, zDirty.toList() }));
+            zAppliers.push_back([=] (const UTXODelta& delta) { replaceAddresses(delta, zDirty); });
+        }
+
+        // The outputs that appeared since the last update. These are merged after the
+        // re-read addresses, since they are from the same point in time.
+        tPayloads.push_back(RPCMethods::payload<RPCMethods::ListUnspent>({ 0, window, {} }));
+        tAppliers.push_back([=] (const UTXODelta& delta) { merge(delta); });
+
+        zPayloads.push_back(RPCMethods::payload<RPCMethods::ZListUnspent>({ 0, window, {} }));
+        zAppliers.push_back([=] (const UTXODelta& delta) { merge(delta); });
+    }
+
+    QList<Future<UTXOReplies>> fetches = { fetch(tPayloads, true), fetch(zPayloads, false) };
+    whenAll(fetches).done([=] (const QList<UTXOReplies>& replies) {
+        if (gen != generation)
+            return;
+
+        auto& t = replies[0];
+        auto& z = replies[1];
+        if (!t.error.isEmpty() || !z.error.isEmpty()) {
+            qDebug() << "Couldn't update unspent outputs:" << (t.error.isEmpty() ? z.error : t.error);
+
+            // Start over from a full reconciliation on the next update
+            lastFullBlock = 0;
+            updating = false;
+            return;
+        }
+
+        for (int i = 0; i < t.deltas.size() && i < tAppliers.size(); i++) {
+            tAppliers[i](t.deltas[i]);
+        }
+        for (int i = 0; i < z.deltas.size() && i < zAppliers.size(); i++) {
+            zAppliers[i](z.deltas[i]);
+        }
+
+        // The pools might have been listed by different nodes, or a block apart
+        auto balance = t.balance;
+        int  tip     = std::max(t.tip, z.tip);
+        if (full) {
+            finish(tip, curBlock, full, balance, cb);
+            return;
+        }
+
+        // Check the set against the balances moonroomcashd has. If a pool doesn't add up,
+        // something was spent or dropped that we couldn't see, so read that pool in full.
+        QList<bool> fixupIsZ;
+        if (spendableTotal(false) != balance.transparent)
+            fixupIsZ.push_back(false);
+        if (spendableTotal(true) != balance.shielded)
+            fixupIsZ.push_back(true);
+
+        if (fixupIsZ.isEmpty()) {
+            finish(tip, curBlock, false, balance, cb);
+            return;
+        }
+
+        qDebug() << "Unspent outputs don't match the balance, reconciling" << fixupIsZ.size() << "pool(s)";
+        rpc->getConnection()->pinReadsToPrimary();
+
+        QList<Future<UTXOReplies>> fixups;
+        for (bool isZ : fixupIsZ) {
+            json unspent = isZ ? RPCMethods::payload<RPCMethods::ZListUnspent>({ 0, -1, {} })
+                               : RPCMethods::payload<RPCMethods::ListUnspent>({ 0, -1, {} });
+            fixups.push_back(fetch({ RPCMethods::payload<RPCMethods::GetBlockchainInfo>(), unspent }, false));
+        }
+
+        whenAll(fixups).done([=] (const QList<UTXOReplies>& fixed) {
+            if (gen != generation)
+                return;
+
+            for (int i = 0; i < fixed.size() && i < fixupIsZ.size(); i++) {
+                if (!fixed[i].error.isEmpty() || fixed[i].deltas.isEmpty()) {
+                    qDebug() << "Couldn't reconcile unspent outputs:" << fixed[i].error;
+                    lastFullBlock = 0;
+                } else {
+                    replaceAll(fixed[i].deltas[0], fixupIsZ[i]);
+                }
+            }
+
+            finish(tip, curBlock, false, balance, cb);
+        }, [=] (const RPCError& error) {
+            if (gen != generation)
+                return;
+
+            qDebug() << error.message;
+            lastFullBlock = 0;
+            updating = false;
+        });
+    }, [=] (const RPCError& error) {
+        if (gen != generation)
+            return;
+
+        qDebug() << error.message;
+        lastFullBlock = 0;
+        updating = false;
+    });
+}
+
+// Send one of the update's requests. The replies are decoded into outputs on the network thread
+// as they arrive, so only applying them to the set happens on the UI thread.
+Future<UTXOReplies> UTXOSet::fetch(const QList<json>& payloads, bool withBalance) {
+    Promise<UTXOReplies> promise;
+    rpc->getConnection()->doRPCArrayRecords<UTXOReplies>(payloads, [=] (QList<BatchReply>& replies) {
+        return decodeReplies(replies, withBalance);
+    }, [=] (UTXOReplies decoded) {
+        promise.resolve(std::move(decoded));
+    }, [=] (const RPCError& error) {
+        promise.reject(error);
+    });
+
+    return promise.future();
+}
+
+/**
+ * The update is done, at the tip the outputs were listed at. If blocks came in after the window was
+ * worked out from sentBlock, the window didn't reach back to the last update any more, so the next
+ * update starts from the same block again.
+ */
+void UTXOSet::finish(int tip, int sentBlock, bool full, RPCMethods::ZGetTotalBalance::Result balance, const std::function<void(RPCMethods::ZGetTotalBalance::Result)>& cb) {
+    if (full || tip <= sentBlock)
+        lastUpdateBlock = tip;
+    if (full)
+        lastFullBlock = tip;
+
+    updating = false;
+    cb(balance);
+}
+
+/**
+ * Fill in the unspent outputs and the per-address balances, the same way listunspent would
+ * have returned them at the current block.
+ */
+void UTXOSet::fill(QList<UnspentOutput>* utxos, QMap<QString, double>* balances) {
+    int curBlock = Settings::getInstance()->getBlockNumber();
+
+    for (auto& entry : entries) {
+        UnspentOutput out = entry.out;
+        out.height        = entry.height;
+        out.confirmations = entry.height > 0 ? std::max(curBlock - entry.height + 1, 1) : 0;
+
+        utxos->push_back(out);
+        (*balances)[out.address] = (*balances)[out.address] + (double)entry.amount / 100000000;
+    }
+}
+
+bool UTXOSet::anyUnconfirmed() {
+    for (auto& entry : entries) {
+        if (entry.height == 0)
+            return true;
+    }
+    return false;
+}
+
+qint64 UTXOSet::spendableTotal(bool z) {
+    qint64 total = 0;
+    for (auto& entry : entries) {
+        if (entry.out.spendable && Settings::isZAddress(entry.out.address) == z)
+            total += entry.amount;
+    }
+    return total;
+}
+
+// Replace all the outputs of one pool with the delta
+void UTXOSet::replaceAll(const UTXODelta& delta, bool z) {
+    for (auto it = entries.begin(); it != entries.end(); ) {
+        if (Settings::isZAddress(it->out.address) == z)
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+
+    merge(delta);
+}
+
+// Replace all the outputs of the given addresses with the delta
+void UTXOSet::replaceAddresses(const UTXODelta& delta, const QSet<QString>& addrs) {
+    for (auto it = entries.begin(); it != entries.end(); ) {
+        if (addrs.contains(it->out.address))
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+
+    merge(delta);
+}
+
+// Add or update the outputs in the delta
+void UTXOSet::merge(const UTXODelta& delta) {
+    for (auto& it : delta) {
+        entries[it.first] = it.second;
+    }
+}
+
+/**
+ * Runs on the network thread. Turns the replies into outputs. The getblockchaininfo reply comes
+ * first, and then the z_gettotalbalance reply if withBalance is set.
+ */
+UTXOReplies UTXOSet::decodeReplies(QList<BatchReply>& replies, bool withBalance) {
+    UTXOReplies decoded;
+
+    for (auto& reply : replies) {
+        if (!reply.error.isEmpty()) {
+            decoded.error = reply.error;
+            return decoded;
+        }
+    }
+
+    RPCMethods::GetBlockchainInfo::Result chain;
+    if (replies.isEmpty() ||
+            !RPCMethods::GetBlockchainInfo::decode(json::parse(replies[0].result.constBegin(), replies[0].result.constEnd(), nullptr, false), chain)) {
+        decoded.error = "Unexpected reply to getblockchaininfo";
+        return decoded;
+    }
+    decoded.tip = chain.blocks;
+
+    int first = 1;
+    if (withBalance && replies.size() > 1) {
+        auto balance = json::parse(replies[1].result.constBegin(), replies[1].result.constEnd(), nullptr, false);
+        if (!RPCMethods::ZGetTotalBalance::decode(balance, decoded.balance)) {
+            decoded.error = "Unexpected reply to z_gettotalbalance";
+            return decoded;
+        }
+        first = 2;
+    }
+
+    for (int i = first; i < replies.size(); i++) {
+        decoded.deltas.push_back(decode(replies[i].unspent, decoded.tip));
+    }
+
+    return decoded;
+}
+
+UTXODelta UTXOSet::decode(const QList<UnspentRecord>& records, int tip) {
+    UTXODelta delta;
+    for (auto& it : records) {
+        UTXOEntry entry;
+        entry.out    = UnspentOutput{ it.address, it.txid, Settings::getDecimalString(it.amount),
+                                      (int)it.confirmations, it.spendable, 0 };
+        entry.amount = qRound64(it.amount * 100000000);
+        entry.height = it.confirmations > 0 ? tip - (int)it.confirmations + 1 : 0;
+
+        delta.push_back(QPair<QString, UTXOEntry>(noteKey(it), entry));
+    }
+
+    return delta;
+}
+
+// Transparent outputs are identified by vout, sprout notes by (jsindex, jsoutindex) and
+// sapling notes by outindex.
+QString UTXOSet::noteKey(const UnspentRecord& note) {
+    if (note.vout >= 0)
+        return note.txid % ":v" % QString::number(note.vout);
+
+    if (note.jsindex >= 0)
+        return note.txid % ":j" % QString::number(note.jsindex) % "." % QString::number(note.jsoutindex);
+
+    return note.txid % ":s" % QString::number(note.outindex);
+}
@@ -0,0 +1,78 @@
+#ifndef UTXOSET_H
+#define UTXOSET_H
+
+#include "precompiled.h"
+#include "rpc.h"
+#include "fastjson.h"
+
+using json = nlohmann::json;
+
+struct UTXOEntry {
+    UnspentOutput   out;
+    qint64          amount;         // In zatoshis, so the totals can be compared exactly
+    int             height;         // Block the output was mined in, 0 if it is not mined yet
+};
+
+// The outputs in one listunspent or z_listunspent reply, keyed by txid:output
+typedef QList<QPair<QString, UTXOEntry>> UTXODelta;
+
+// All the replies of one update, decoded on the network thread
+struct UTXOReplies {
+    QString                                 error;
+    int                                     tip     = 0;    // The block the outputs are at, from getblockchaininfo
+    RPCMethods::ZGetTotalBalance::Result    balance;
+    QList<UTXODelta>                        deltas;     // One for each listunspent/z_listunspent call, in order
+};
+
+/**
+ * The wallet's unspent transparent outputs and shielded notes, kept up to date block by block
+ * instead of downloading all of them on every refresh.
+ *
+ * Each update only asks moonroomcashd for the outputs that are new since the last update (using the
+ * maxconf of listunspent/z_listunspent) and re-reads the addresses that are known to have spent
+ * something, for eg. the from address of a tx we sent. The sums are then checked against
+ * z_gettotalbalance, and if they don't match (a spend we didn't see, a dropped tx), that pool
+ * is fully reconciled. A full reconciliation also runs every few blocks, just to be safe.
+ *
+ * The transparent and the shielded outputs are read with separate requests, which moonroomcashd
+ * answers in parallel, and joined with whenAll.
+ */
+class UTXOSet {
+public:
+    UTXOSet(RPC* _rpc);
+
+    void    update(const std::function<void(RPCMethods::ZGetTotalBalance::Result)>& cb);
+    void    markDirty(const QString& addr);
+    void    reset();
+
+    void    fill(QList<UnspentOutput>* utxos, QMap<QString, double>* balances);
+    bool    anyUnconfirmed();
+
+private:
+    void    finish(int tip, int sentBlock, bool full, RPCMethods::ZGetTotalBalance::Result balance, 
+                   const std::function<void(RPCMethods::ZGetTotalBalance::Result)>& cb);
+
+    void    replaceAll(const UTXODelta& delta, bool z);
+    void    replaceAddresses(const UTXODelta& delta, const QSet<QString>& addrs);
+    void    merge(const UTXODelta& delta);
+
+    qint64  spendableTotal(bool z);
+
+    Future<UTXOReplies> fetch(const QList<json>& payloads, bool withBalance);
+
+    static UTXOReplies  decodeReplies(QList<BatchReply>& replies, bool withBalance);
+    static UTXODelta    decode(const QList<UnspentRecord>& records, int tip);
+    static QString      noteKey(const UnspentRecord& note);
+
+    RPC*    rpc;
+
+    QMap<QString, UTXOEntry>    entries;        // txid:output -> unspent output
+    QSet<QString>               dirty;          // Addresses to re-read on the next update
+
+    int     lastUpdateBlock = 0;
+    int     lastFullBlock   = 0;
+    bool    updating        = false;
+    int     generation      = 0;        // Bumped by reset(), so replies to an abandoned update are dropped
+};
+
+#endif // UTXOSET_H
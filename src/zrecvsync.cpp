@@ -0,0 +1,238 @@
+#include "zrecvsync.h"
+#include "settings.h"
+
+using json = nlohmann::json;
+
+ZRecvSync::ZRecvSync(RPC* _rpc) {
+    this->rpc = _rpc;
+}
+
+// Forget all the scans. A sync that is still running is abandoned, its replies are from the old connection.
+void ZRecvSync::reset() {
+    watermarks.clear();
+    received.clear();
+    dirty.clear();
+    cursor = 0;
+
+    generation++;
+    syncing = false;
+}
+
+// Scan this address on the next tick, for eg. because it just got a new note
+void ZRecvSync::markDirty(const QString& zaddr) {
+    dirty.insert(zaddr);
+}
+
+/**
+ * Pick the addresses to scan this tick: Addresses that were never scanned, addresses that were
+ * marked dirty and the next shard of all the addresses, round robin.
+ */
+QList<QString> ZRecvSync::selectShard(const QList<QString>& zaddrs) {
+    QList<QString> toScan;
+    QSet<QString>  picked;
+
+    for (auto zaddr : zaddrs) {
+        if (!watermarks.contains(zaddr) || dirty.contains(zaddr)) {
+            toScan.push_back(zaddr);
+            picked.insert(zaddr);
+        }
+    }
+    dirty.clear();
+
+    if (zaddrs.isEmpty())
+        return toScan;
+
+    int shardSize = std::min(Settings::getInstance()->getZRecvShardSize(), zaddrs.size());
+    for (int i = 0; i < shardSize; i++) {
+        auto zaddr = zaddrs[(cursor + i) % zaddrs.size()];
+        if (!picked.contains(zaddr)) {
+            toScan.push_back(zaddr);
+            picked.insert(zaddr);
+        }
+    }
+    cursor = (cursor + shardSize) % zaddrs.size();
+
+    return toScan;
+}
+
+QList<TransactionItem> ZRecvSync::allReceived() {
+    QList<TransactionItem> txdata;
+    for (auto& txids : received) {
+        for (auto& notes : txids) {
+            for (auto& tx : notes) {
+                txdata.push_back(tx);
+            }
+        }
+    }
+
+    return txdata;
+}
+
+/**
+ * Scan this tick's addresses for received txs, and call the callback with all the received txs.
+ */
+void ZRecvSync::sync(const QList<QString>& zaddrs, const std::function<void(QList<TransactionItem>)>& cb) {
+    auto conn = rpc->getConnection();
+    if (conn == nullptr || syncing)
+        return;
+
+    // Forget about addresses that are not in the wallet anymore
+    QSet<QString> current = zaddrs.toSet();
+    for (auto zaddr : watermarks.keys()) {
+        if (!current.contains(zaddr)) {
+            watermarks.remove(zaddr);
+            received.remove(zaddr);
+        }
+    }
+
+    auto toScan = selectShard(zaddrs);
+    if (toScan.isEmpty()) {
+        cb(allReceived());
+        return;
+    }
+
+    syncing = true;
+    int curBlock = Settings::getInstance()->getBlockNumber();
+    int gen      = generation;
+
+    // This is complicated because z_listreceivedbyaddress only returns the txid, and 
+    // we have to make a follow up call to gettransaction to get details of that transaction. 
+    // Additionally, it has to be done in batches, because there are multiple z-Addresses, 
+    // and each z-Addr can have multiple received txs. 
+
+    // Nothing that was scanned changes, and the addresses are scanned again on the next tick
+    auto fnFailed = [=] () {
+        for (auto zaddr : toScan) {
+            dirty.insert(zaddr);
+        }
+        syncing = false;
+    };
+
+    // 1. For each z-Addr, get list of received txs    
+    conn->doBatchRPC<QString>(toScan,
+        [=] (QString zaddr) {
+            return RPCMethods::payload<RPCMethods::ZListReceivedByAddress>({ zaddr, 0 });    // Accept 0 conf as well.
+        },          
+        [=] (QMap<QString, json>* replies) {
+            if (gen != generation) {
+                delete replies;
+                return;
+            }
+
+            // Addresses whose reply didn't decode are left as they were, and scanned again on the next tick
+            typedef QMap<QString, RPCMethods::ZListReceivedByAddress::Result> NoteLists;
+            auto zaddrNotes = std::make_shared<NoteLists>();
+            for (auto it = replies->constBegin(); it != replies->constEnd(); it++) {
+                RPCMethods::ZListReceivedByAddress::Result notes;
+                if (RPCMethods::ZListReceivedByAddress::decode(it.value(), notes))
+                    (*zaddrNotes)[it.key()] = notes;
+                else
+                    dirty.insert(it.key());
+            }
+            delete replies;
+
+            // Process all the new and shallow txids, removing duplicates. This can happen if the same 
+            // address appears multiple times in a single tx's outputs.
+            QSet<QString> txids;
+            QMap<QString, QString> memos;
+            for (auto it = zaddrNotes->constBegin(); it != zaddrNotes->constEnd(); it++) {
+                auto zaddr = it.key();
+
+                auto deepTxids = watermarks.value(zaddr).deepTxids;
+                for (auto& note : it.value()) {   
+                    // Filter out change txs
+                    if (note.change) 
+                        continue;
+
+                    if (deepTxids.contains(note.txid))
+                        continue;
+
+                    txids.insert(note.txid);    
+
+                    // Check for Memos
+                    if (!note.memo.startsWith("f600"))  {
+                        QString memo(QByteArray::fromHex(note.memo.toUtf8()));
+                        if (!memo.trimmed().isEmpty())
+                            memos[zaddr + note.txid] = memo;
+                    }
+                }        
+            }
+
+            // 2. For all txids, go and get the details of that txid.
+            rpc->getTxDetails(txids.toList(),
+                [=] (QMap<QString, json>* txidDetails) {
+                    if (gen != generation) {
+                        delete txidDetails;
+                        return;
+                    }
+
+                    int reorgDepth = Settings::getInstance()->getReorgDepth();
+
+                    // Combine them both together. For every zAddr's txid, get the amount, fee, confirmations and time
+                    for (auto it = zaddrNotes->constBegin(); it != zaddrNotes->constEnd(); it++) {                        
+                        auto zaddr = it.key();
+
+                        auto& mark  = watermarks[zaddr];
+                        auto& notes = received[zaddr];
+
+                        // The deep txs stay as they are, everything else is replaced by what was just seen
+                        for (auto txid : notes.keys()) {
+                            if (!mark.deepTxids.contains(txid))
+                                notes.remove(txid);
+                        }
+
+                        for (auto& note : it.value()) {   
+                            // Filter out change txs
+                            if (note.change)
+                                continue;
+                            
+                            if (mark.deepTxids.contains(note.txid))
+                                continue;
+
+                            // Lookup txid in the map
+                            RPCMethods::GetTransaction::Details details;
+                            if (!RPCMethods::GetTransaction::details(txidDetails->value(note.txid), details))
+                                continue;
+
+                            // A conflicted tx (negative confirmations) isn't in the chain, so it counts as unconfirmed
+                            auto confirmations = details.confirmations > 0 ? (unsigned long)details.confirmations : 0;
+                            auto height        = confirmations > 0 ? curBlock - (int)confirmations + 1 : 0;
+
+                            TransactionItem tx{ QString("receive"), details.time, zaddr, note.txid, note.amount, 
+                                                confirmations, "", memos.value(zaddr + note.txid, ""),
+                                                height, details.blockhash };
+                            notes[note.txid].push_back(tx);
+                        }
+
+                        // Txs that are buried deep enough will never be looked at again for this address
+                        for (auto txid : notes.keys()) {
+                            if (!notes[txid].isEmpty() && notes[txid].first().confirmations >= (unsigned long)reorgDepth)
+                                mark.deepTxids.insert(txid);
+                        }
+                        mark.lastSeenBlock = curBlock;
+                    }
+
+                    // Cleanup the response
+                    delete txidDetails;
+
+                    syncing = false;
+                    cb(allReceived());
+                },
+                [=] (const RPCError& error) {
+                    if (gen != generation)
+                        return;
+
+                    qDebug() << "Couldn't look up the received z txs:" << error.errorMessage();
+                    fnFailed();
+                }
+            );
+        },
+        [=] (const RPCError& error) {
+            if (gen != generation)
+                return;
+
+            qDebug() << "Couldn't list the received z txs:" << error.errorMessage();
+            fnFailed();
+        }
+    );
+}
@@ -0,0 +1,49 @@
+#ifndef ZRECVSYNC_H
+#define ZRECVSYNC_H
+
+#include "precompiled.h"
+#include "rpc.h"
+
+using json = nlohmann::json;
+
+// How far each z-address has been scanned
+struct ZAddrWatermark {
+    int             lastSeenBlock;      // Block at which the address was last scanned
+    QSet<QString>   deepTxids;          // Txids that are processed and buried past the reorg depth
+};
+
+/**
+ * Keeps track of the txs received by each z-address. z_listreceivedbyaddress always returns all
+ * the notes of an address, so for every address we remember which txs are already processed and 
+ * buried deep enough to not change anymore. Only the notes that are new or not yet deep are 
+ * decoded and looked up. 
+ *
+ * Addresses are also spread across refresh ticks: each tick scans a shard of the addresses (along
+ * with any new or recently active ones), so a wallet with lots of addresses doesn't have to scan 
+ * all of them every block.
+ */
+class ZRecvSync {
+public:
+    ZRecvSync(RPC* _rpc);
+
+    void    sync(const QList<QString>& zaddrs, const std::function<void(QList<TransactionItem>)>& cb);
+    void    markDirty(const QString& zaddr);
+    bool    isScanned(const QString& zaddr) const { return watermarks.contains(zaddr); }
+    void    reset();
+
+private:
+    QList<QString>          selectShard(const QList<QString>& zaddrs);
+    QList<TransactionItem>  allReceived();
+
+    RPC*    rpc;
+
+    QMap<QString, ZAddrWatermark>                           watermarks;
+    QMap<QString, QMap<QString, QList<TransactionItem>>>    received;   // zaddr -> txid -> notes
+    QSet<QString>                                           dirty;      // To be scanned on the next tick
+
+    int     cursor      = 0;        // Where the next shard starts
+    bool    syncing     = false;
+    int     generation  = 0;        // Bumped by reset(), so replies to an abandoned sync are dropped
+};
+
+#endif // ZRECVSYNC_H